@@ -1,121 +1,724 @@
 #include <stdio.h>        // For standard input/output operations like printf
 #include <stdlib.h>       // For atoi() to convert strings to integers
 #include <string.h>       // For strcmp() to compare option strings
+#include <stdarg.h>       // For out_text()'s printf-style arguments
 #include <unistd.h>       // For getuid() and other POSIX functions
 #include <sys/types.h>    // Defines pid_t for process IDs
-#include <dirent.h>       // For directory operations with /proc
+#include <dirent.h>       // For DT_DIR and DT_UNKNOWN entry types
 #include <signal.h>       // For signal handling like SIGKILL, SIGSTOP
-#include <ctype.h>        // For isdigit() to filter /proc entries
 #include <errno.h>        // For errno and error handling
+#include <fcntl.h>        // For open() on /proc/[pid]/stat
+#include <pthread.h>      // For parallel snapshot parsing (--jobs)
+#include <stdint.h>       // For fixed-width fields in getdents64 records
+#include <sys/syscall.h>  // For SYS_getdents64
+#include <sys/socket.h>   // For the daemon's netlink and Unix sockets
+#include <sys/un.h>       // For sockaddr_un
+#include <sys/stat.h>     // For checking a stale daemon socket
+#include <sys/time.h>     // For client receive timeouts
+#include <poll.h>         // For the daemon event loop
+#include <linux/netlink.h>   // For NETLINK_CONNECTOR
+#include <linux/connector.h> // For cn_msg and CN_IDX_PROC
+#include <linux/cn_proc.h>   // For proc_event (FORK/EXEC/EXIT)
+#include <sys/resource.h> // For raising RLIMIT_NOFILE before opening pidfds
+#include <time.h>         // For clock_gettime() in per-round timing
+#include <sys/wait.h>     // For reaping benchmark trees
+#include <sys/prctl.h>    // For PR_SET_CHILD_SUBREAPER in --bench
+#include <sys/mman.h>     // For mapping the io_uring rings
+#include <linux/io_uring.h> // For --uring's submission and completion records
+#ifdef __SSE2__
+#include <emmintrin.h>    // For the SSE2 column kernels; scalar loops otherwise
+#endif
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434        // Linux 5.3; missing from older libc headers
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424 // Linux 5.1
+#endif
+#ifndef SYS_io_uring_setup
+#define SYS_io_uring_setup 425    // Linux 5.1; glibc has no wrappers
+#endif
+#ifndef SYS_io_uring_enter
+#define SYS_io_uring_enter 426
+#endif
+#ifndef SYS_io_uring_register
+#define SYS_io_uring_register 427
+#endif
 
 // Custom structure to hold process details fetched from /proc
 typedef struct {
     pid_t pid;    // Process ID
     pid_t ppid;   // Parent Process ID
     char state;   // Process state (e.g., 'Z' for zombie)
+    unsigned long long starttime; // Start time after boot, clock ticks; with pid, identifies the process (0: unknown)
 } ProcessInfo;
 
+// Fields past ppid on the same stat line; parsed only when a query needs them
+typedef struct {
+    char comm[16];                // Command name, truncated like the kernel's TASK_COMM_LEN
+    unsigned long utime;          // User CPU time, clock ticks
+    unsigned long stime;          // System CPU time, clock ticks
+    unsigned long long starttime; // Start time after boot, clock ticks
+    long rss;                     // Resident set size, pages
+    int num_threads;              // Threads in the process
+    pid_t pgrp;                   // Process group ID
+    pid_t session;                // Session ID
+    char loaded;                  // 1 once the fields above are filled (zeroed if the process was gone)
+} ProcessExt;
+
+#define SNAPSHOT_BASIC    0 // pid, ppid and state only
+#define SNAPSHOT_EXTENDED 1 // Also parse ProcessExt for every record during the scan
+
+#define PID_MAX_LIMIT (1 << 22)  // Largest pid_max the kernel allows; --ns values above it are inodes
+#define CHILDREN_WALK_LIMIT 4096 // Subtree size past which a children-file walk gives way to a full scan
+#define URING_BATCH 128          // Stat files per io_uring submission: one openat+read+close chain each
+
+#define DEPTH_CYCLE -1 // Slot whose parent chain loops (PIDs reused mid-scan) instead of reaching a top
+
+// In-memory copy of the process table, filled by a single /proc scan
+typedef struct {
+    ProcessInfo *procs; // Compact array of process records
+    int count;          // Number of records in procs
+    int capacity;       // Allocated length of procs
+    int *slot_of;       // PID-indexed lookup: slot + 1, or 0 when absent
+    pid_t max_pid;      // Largest PID seen; bounds slot_of
+    int *child_start;   // CSR offsets: children of slot i are child_slots[child_start[i] .. child_start[i + 1])
+    int *child_slots;   // CSR payload: child slots grouped by parent
+    int *depth;         // Per slot: parent links to the top of its chain, or DEPTH_CYCLE
+    int *tin;           // Per slot: DFS entry time, the slot's row in the columns below
+    int *tout;          // Per slot: DFS exit time; the subtree is rows [tin .. tout)
+    pid_t *dfs_pid;     // Column-wise copy of procs in DFS preorder: PIDs
+    pid_t *dfs_ppid;    // Parent PIDs, parallel to dfs_pid
+    char *dfs_state;    // States, parallel to dfs_pid; one byte per row for 16-wide compares
+    int *dfs_slot;      // Slot of each row, for per-slot data such as ext
+    ProcessExt *ext;    // Per slot: extended fields, filled by the scan or on first use
+    int ext_complete;   // Whether the scan filled ext for every slot (SNAPSHOT_EXTENDED)
+    pid_t *ns_pid;      // --ns full scans: per slot, the PID inside the namespace (last NSpid field), else NULL
+    void *map;          // --from-snapshot: every array above points into this file mapping
+    size_t map_size;    // Length of map
+} ProcessTable;
+
+// Sections of a --save-snapshot file, in file order; each is one ProcessTable array stored verbatim
+enum {
+    SNAP_PROCS, SNAP_SLOT_OF, SNAP_CHILD_START, SNAP_CHILD_SLOTS, SNAP_DEPTH, SNAP_TIN, SNAP_TOUT,
+    SNAP_DFS_PID, SNAP_DFS_PPID, SNAP_DFS_STATE, SNAP_DFS_SLOT, SNAP_EXT, SNAP_SECTION_COUNT
+};
+
+#define SNAPSHOT_FILE_MAGIC   "PHSNAP\0" // Eight bytes with the terminator
+#define SNAPSHOT_FILE_VERSION 2          // Bump on any change to the header or the arrays (2: starttime in records)
+#define SNAPSHOT_FILE_ALIGN   64         // Sections start on cache-line boundaries
+
+// Fixed header at offset 0; arrays are in host byte order, so a file is read back on the same architecture
+typedef struct {
+    char magic[8];                       // SNAPSHOT_FILE_MAGIC
+    uint32_t version;                    // SNAPSHOT_FILE_VERSION
+    uint32_t header_size;                // sizeof(SnapshotFileHeader)
+    uint32_t info_size;                  // sizeof(ProcessInfo) of the writer
+    uint32_t ext_size;                   // sizeof(ProcessExt) of the writer
+    int64_t captured;                    // Wall-clock seconds when /proc was read
+    int32_t count;                       // Records
+    int32_t max_pid;                     // slot_of covers PIDs 0 .. max_pid
+    uint64_t offset[SNAP_SECTION_COUNT]; // Byte offset of each section
+    uint64_t size[SNAP_SECTION_COUNT];   // Byte length of each section
+} SnapshotFileHeader;
+
+// Growable PID arena: one block reserved up front from a known size, doubled only if outgrown
+typedef struct {
+    pid_t *pids;  // Contiguous PID storage
+    int count;    // PIDs stored
+    int capacity; // PIDs that fit without growing
+} PidArena;
+
+// Victims resolved from a snapshot, pinned by pidfd where the kernel allows
+typedef struct {
+    PidArena victims; // PIDs in delivery order
+    int *pidfds;      // Parallel to victims: a pidfd, or one of the SIGNAL_* markers below
+} SignalBatch;
+
+#define SIGNAL_VIA_KILL    -1 // No pidfd available; fall back to kill()
+#define SIGNAL_SKIP_GONE   -2 // Exited between the scan and pinning
+#define SIGNAL_SKIP_REUSED -3 // PID now belongs to a different process
+#define SIGNAL_SKIP_MOVED  -4 // Same process, but reparented since the scan
+#define SIGNAL_SKIP_UNCHECKED -5 // No descriptor left to re-read its stat, so it cannot be confirmed
+
+#define KILL_FREEZE_ROUNDS 8  // Upper bound on -sk's stop-and-rescan rounds
+#define SIGNAL_PARALLEL_MIN 256 // Victims per worker below which a level is signalled on the calling thread
+#define SIGNAL_ERRNO_LIMIT 256  // Outcome buckets per delivery: 0 for delivered, then one per errno value
+
+// One worker's share of a level: a victim range and the disjoint result slots it owns
+typedef struct {
+    const SignalBatch *batch; // Pinned victims
+    int begin;                // First victim index of the range
+    int end;                  // One past the last
+    int sig;                  // Signal to send
+    int *result;              // Parallel to victims: 0, an errno value, or SIGNAL_SKIP_REUSED/MOVED/UNCHECKED
+} SignalChunk;
+
+// A parent of zombies under the --pz target, keyed by its slot
+typedef struct {
+    pid_t pid;   // Parent PID
+    int slot;    // Parent slot in the snapshot
+    int zombies; // Its zombie children within the target's subtree
+} ZombieParent;
+
+// Global flags that apply to every option, parsed ahead of the positional arguments
+typedef struct {
+    int jobs;                   // Threads used to parse /proc/[pid]/stat files (--jobs N)
+    const char *daemon_socket;  // Serve queries on this Unix socket (--daemon PATH)
+    const char *connect_socket; // Send the query to a daemon on this socket (--connect PATH)
+    int batch;                  // Read many queries, answer them from one snapshot (--batch [FILE])
+    int cgroup;                 // Use cgroup.kill / cgroup.freeze when a subtree is exactly one cgroup (--cgroup)
+    int bench;                  // Time every option on synthetic trees instead of answering a query (--bench)
+    int stats;                  // Report counters and phase timers at exit: STATS_TEXT or STATS_JSON (--stats[=json])
+    int format;                 // Answer encoding on stdout: FORMAT_TEXT, FORMAT_JSONL or FORMAT_BIN (--format=...)
+    int uring;                  // Read stat files for full scans through io_uring (--uring)
+    const char *save_snapshot;  // Also write the full table to this file (--save-snapshot FILE)
+    const char *from_snapshot;  // Answer from this saved table instead of /proc (--from-snapshot FILE)
+    int verbose;                // One line per signalled PID instead of a summary (--verbose)
+    int dry_run;                // --pz lists the parents it would kill and kills none (--dry-run)
+    int min_zombies;            // --pz skips parents with fewer zombie children (--min-zombies N)
+    unsigned long long ns_inode; // Scan only members of this PID namespace, 0 for all (--ns INODE|PID)
+    int max_depth;              // -tree: levels shown below the target, -1 for all (--max-depth N)
+    int top;                    // -tree: children shown per node, 0 for all (--top N)
+    int rank;                   // -tree: what --top ranks by, RANK_PROCS or RANK_RSS (--rank=...)
+} RunOptions;
+
+#define STATS_TEXT 1 // --stats
+#define STATS_JSON 2 // --stats=json
+
+#define RANK_PROCS 0 // --rank=procs: largest subtrees first (default)
+#define RANK_RSS   1 // --rank=rss: most resident memory first
+
+#define FORMAT_TEXT  0 // Human-readable lines (default)
+#define FORMAT_JSONL 1 // One JSON object per record
+#define FORMAT_BIN   2 // Length-prefixed binary records
+
+static RunOptions run_options = {1, NULL, NULL, 0, 0, 0, 0, FORMAT_TEXT, 0, NULL, NULL, 0, 0, 1, 0, -1, 0, 0}; // Single-threaded, one-shot unless flags say otherwise
+
+// Work counters for the hot paths; relaxed atomics let --jobs workers share them
+typedef struct {
+    unsigned long syscalls;   // open/pread/close/getdents64/pidfd/kill calls issued
+    unsigned long stat_reads; // /proc/[pid]/stat files read
+    unsigned long dir_scans;  // Full enumerations of /proc
+    unsigned long tree_checks; // Membership checks answered by is_in_tree()
+} ScanCounters;
+
+static ScanCounters scan_counters; // Process-wide totals
+#define COUNT(field, n) __atomic_fetch_add(&scan_counters.field, (n), __ATOMIC_RELAXED)
+
+// Wall-clock phases reported by --stats; query time includes any signal time spent inside it
+enum { PHASE_ENUMERATE, PHASE_PARSE, PHASE_INDEX, PHASE_QUERY, PHASE_SIGNAL, PHASE_COUNT };
+static const char *phase_names[PHASE_COUNT] = {"enumerate", "parse", "index", "query", "signal"};
+static double phase_ms[PHASE_COUNT]; // Accumulated milliseconds per phase, main thread only
+
+// One question asked of a snapshot: which tree, which process, and what to do
+typedef struct {
+    pid_t root_pid;     // Root of the process tree
+    pid_t target_pid;   // Process to analyze or manipulate
+    const char *option; // Operation flag, NULL for basic info
+    int value;          // Numeric argument: level for -depth N, top-K for -agg [K]
+} Query;
+
+#define AGG_DEFAULT_TOP 10 // Child subtrees -agg prints when K is not given
+
+// What a query reads from /proc, cheapest first; query_plan() picks one per option
+enum {
+    PLAN_POINT,     // The target's own record (no option, -do)
+    PLAN_ANCESTORS, // The target's parent chain up to the root (-rp)
+    PLAN_CHILDREN,  // The target's direct children (-id)
+    PLAN_SUBTREE,   // Everything below the target (-dc, -ds, -df, -gc, -depth, -sum, -agg, signals)
+    PLAN_TABLE      // Processes outside the target's subtree too (-lg, -lz)
+};
+
+// Stages of the listing pipeline (run_pipeline()); each handler passes one constant per stage
+enum {
+    SOURCE_TABLE,       // Every row of the snapshot
+    SOURCE_SUBTREE,     // The target's DFS range, target included
+    SOURCE_DESCENDANTS, // The same range without the target
+    SOURCE_LEVEL        // Descendants exactly N levels down, in BFS order
+};
+enum {
+    RELATION_ANY,       // No parent test
+    RELATION_CHILD,     // Parent is the target
+    RELATION_NOT_CHILD, // Parent is not the target
+    RELATION_SIBLING    // Same parent as the target, target excluded
+};
+enum {
+    SINK_LIST,          // out_pid() every match
+    SINK_COUNT          // Only count matches
+};
+
+#define PIPELINE_INLINE static inline __attribute__((always_inline)) // Specialized per call site
+
+// Record kinds for --format=jsonl|bin; the enum value is the binary type, so append only
+enum {
+    OUT_QUERY,          // Batch header: the query line that the following records answer
+    OUT_NOT_IN_TREE,    // Target is outside the root's tree
+    OUT_PROCESS,        // No option: PID and PPID
+    OUT_PID,            // One PID of a listing option (-ds, -id, -lg, -lz, -df, -gc, -depth)
+    OUT_DEFUNCT_COUNT,  // -dc
+    OUT_STATUS,         // -do
+    OUT_SUBTREE,        // -sum, and the -agg header: totals over the target's subtree
+    OUT_CHILD_SUBTREE,  // -agg: one ranked child subtree
+    OUT_SIGNALLED,      // A descendant (or the root, for -rp) accepted a signal
+    OUT_PARENT_KILLED,  // --pz: parent of a zombie killed
+    OUT_NO_ZOMBIES,     // --pz found nothing to do
+    OUT_CGROUP,         // --cgroup: a control file was written instead of signalling
+    OUT_WATCH_START,    // -w: watch began
+    OUT_NEW,            // -w: new descendant
+    OUT_NEW_DEFUNCT,    // -w: new descendant that is already a zombie
+    OUT_BECAME_DEFUNCT, // -w: known descendant turned into a zombie
+    OUT_EXITED,         // -w: descendant is gone
+    OUT_WATCH_END,      // -w: target exited
+    OUT_SIGNAL_OUTCOME, // -sk, -st, -dt: victims per outcome (errno 0: delivered; -3: PID reused; -4: reparented)
+    OUT_ZOMBIE_PARENT,  // --pz: one ranked parent, killed or (--dry-run) only listed
+    OUT_TREE_NODE,      // -tree: one process, or a collapsed run of identical leaves (count > 1)
+    OUT_TREE_MORE,      // -tree: children of the node above pruned by --top
+    OUT_KIND_COUNT
+};
+
+// Name and fields of one record kind; every field is a signed 64-bit integer
+typedef struct {
+    const char *name;      // "type" in JSON lines
+    const char *fields[8]; // Integer fields in record order, NULL-terminated
+    const char *text;      // Name of the trailing string (comm, path, query line), NULL if none
+} OutKind;
+
+#define OUT_BUFFER_LIMIT (4 << 20) // Write out early past this many buffered bytes
+
+// Bottom-up totals for every node of one subtree, indexed by DFS row minus first
+typedef struct {
+    int first;            // DFS row of the subtree root
+    int n;                // Rows in the subtree
+    long *procs;          // Processes in each node's subtree, itself included
+    long *zombies;        // Zombies among them
+    long *threads;        // Extended columns below: NULL unless built with SNAPSHOT_EXTENDED
+    long *rss;            // Resident pages
+    unsigned long long *utime; // User CPU ticks
+    unsigned long long *stime; // System CPU ticks
+} Rollup;
+
+// One line under a -tree node: a child subtree, or a run of identical leaf children collapsed into one
+typedef struct {
+    int row;    // Rollup index of the child, or of the run's first member
+    int count;  // Members: 1 for a single child
+    long procs; // Processes the line stands for
+    long rss;   // Their resident pages
+} TreeEntry;
+
+// A -tree node whose children are being printed; the frames form an explicit stack, not recursion
+typedef struct {
+    TreeEntry *entries; // Ranked and pruned children
+    int n;              // Entries kept
+    int next;           // Next entry to print
+    int hidden;         // Entries pruned by --top
+    long hidden_procs;  // Processes under them
+    size_t indent_len;  // Bytes of the shared indent buffer that belong to this node's children
+} TreeFrame;
+
+// A leaf child, keyed for collapsing runs of identical workers
+typedef struct {
+    char comm[16]; // Command name
+    char state;    // Only leaves in the same state collapse together
+    int row;       // Rollup index
+} TreeLeaf;
+
+// Function declarations for the process table snapshot
+int parse_global_flags(int *argc, char *argv[]);                           // Strips --jobs etc. from argv
+int enumerate_pids(pid_t **pids);                                          // Lists PIDs present in /proc
+unsigned long long pid_ns_inode(pid_t pid);                                // Inode of pid's PID namespace, 0 if unreadable
+pid_t read_ns_pid(pid_t pid);                                              // pid as its innermost namespace sees it
+int ns_filter_pids(pid_t *pids, int n, unsigned long long inode);          // Keeps only members of one namespace
+static pid_t ns_host_pid(const ProcessTable *table, pid_t local);          // Namespace-local PID to host PID
+pid_t parse_pid_name(const char *name);                                    // Strict decimal PID parser
+int snapshot_build(ProcessTable *table, int fields);                       // Reads /proc once into table
+int snapshot_build_chain(ProcessTable *table, pid_t root_pid, pid_t pid);  // Reads pid's ancestors only
+int snapshot_build_subtree(ProcessTable *table, pid_t root_pid, pid_t pid, int levels, int fields); // Ancestors plus subtree
+int snapshot_build_for(ProcessTable *table, const Query *query);           // Gathers what query_plan() asks for
+int snapshot_index(ProcessTable *table);                                   // Builds lookups over table->procs
+int snapshot_index_children(ProcessTable *table);                          // (Re)builds the children index
+int snapshot_index_order(ProcessTable *table);                             // Depth and Euler-tour labels
+void snapshot_free(ProcessTable *table);                                   // Releases snapshot memory
+int snapshot_save(const ProcessTable *table, const char *path);            // Writes a snapshot file
+int snapshot_load(ProcessTable *table, const char *path);                  // Maps a snapshot file
+int snapshot_acquire(ProcessTable *table, const Query *query);             // Loads, saves or plans a table
+const ProcessInfo *snapshot_find(const ProcessTable *table, pid_t pid);    // PID lookup in snapshot
+int snapshot_slot(const ProcessTable *table, pid_t pid);                   // PID to slot, -1 if absent
+int snapshot_parent(const ProcessTable *table, int slot);                  // Parent slot, -1 if absent or stale
+int snapshot_subtree(const ProcessTable *table, pid_t pid, int **slots);   // BFS slots of pid's subtree
+int snapshot_range(const ProcessTable *table, pid_t pid, int *n);           // First DFS row of pid's subtree
+const ProcessExt *snapshot_ext(const ProcessTable *table, int slot);       // Extended fields, loaded lazily
+void snapshot_reset_ext(ProcessTable *table);                              // Forgets lazily loaded fields
+int rollup_build(const ProcessTable *table, pid_t pid, int fields, Rollup *rollup); // Post-order subtree totals
+void rollup_free(Rollup *rollup);                                          // Releases rollup columns
+int column_select_state(const char *state, int n, char want, int *out);    // Rows in a state
+int column_select_ppid(const pid_t *ppid, int n, pid_t want, int equal, int *out); // Rows with (or without) a parent
+int collect_descendants_deepest_first(const ProcessTable *table, pid_t pid, PidArena *out); // Kill order
+
+// Function declarations for the PID arena
+int pid_arena_reserve(PidArena *arena, int capacity);                      // Ensures room for capacity PIDs
+int pid_arena_push(PidArena *arena, pid_t pid);                            // Appends one PID
+void pid_arena_free(PidArena *arena);                                      // Releases the arena
+
+// Function declarations for the signal delivery engine
+int signal_batch_pin(SignalBatch *batch, const ProcessTable *table);       // Opens and validates pidfds
+int signal_batch_send(const SignalBatch *batch, int i, int sig);           // Signals victim i
+void signal_batch_free(SignalBatch *batch);                                // Closes pidfds
+static const char *signal_skip_reason(int marker);                         // Why pinning skipped a victim, or NULL
+int cgroup_match_subtree(const ProcessTable *table, pid_t target, const PidArena *victims, char *dir, size_t size); // Exact cgroup?
+int cgroup_write(const char *dir, const char *file, const char *value);    // Writes a cgroup control file
+
 // Function declarations for process tree operations
-int is_in_tree(pid_t root_pid, pid_t target_pid);              // Checks if a PID is in a tree
-ProcessInfo get_process_info(pid_t pid);                       // Fetches process info from /proc
-void print_basic_info(pid_t pid);                              // Prints PID and PPID
-int count_defunct_descendants(pid_t pid);                      // Counts zombie descendants
-void list_non_direct_descendants(pid_t pid, pid_t parent);     // Lists non-direct descendants
-void list_immediate_descendants(pid_t pid);                    // Lists direct children
-void list_siblings(pid_t pid);                                 // Lists sibling processes
-void list_defunct_siblings(pid_t pid);                         // Lists zombie siblings
-void list_defunct_descendants(pid_t pid);                      // Lists zombie descendants
-void list_grandchildren(pid_t pid);                            // Lists grandchildren
-void print_status(pid_t pid);                                  // Prints process status
-void kill_zombie_parents(pid_t pid);                           // Kills parents of zombies
-void kill_descendants(pid_t pid);                              // Kills all descendants
-void stop_descendants(pid_t pid);                              // Stops all descendants
-void continue_descendants(pid_t pid);                          // Continues stopped descendants
-void print_error(const char *msg, int errnum);                 // Custom error printer
+int is_in_tree(const ProcessTable *table, pid_t root_pid, pid_t target_pid);  // Checks if a PID is in a tree
+ProcessInfo get_process_info(pid_t pid);                                       // Fetches process info from /proc
+ProcessInfo get_process_record(pid_t pid, ProcessExt *ext);                    // Same, plus extended fields
+int parse_stat_line(const char *buf, size_t len, ProcessInfo *info);           // Parses a /proc/[pid]/stat line
+int parse_stat_ext(const char *buf, size_t len, ProcessExt *ext);              // Parses the fields past ppid
+void print_basic_info(const ProcessTable *table, pid_t pid);                   // Prints PID and PPID
+int count_defunct_descendants(const ProcessTable *table, pid_t pid);           // Counts zombie descendants
+void list_non_direct_descendants(const ProcessTable *table, pid_t pid);        // Lists non-direct descendants
+void list_immediate_descendants(const ProcessTable *table, pid_t pid);         // Lists direct children
+void list_siblings(const ProcessTable *table, pid_t pid);                      // Lists sibling processes
+void list_defunct_siblings(const ProcessTable *table, pid_t pid);              // Lists zombie siblings
+void list_defunct_descendants(const ProcessTable *table, pid_t pid);           // Lists zombie descendants
+void list_grandchildren(const ProcessTable *table, pid_t pid);                 // Lists grandchildren
+void list_descendants_at_depth(const ProcessTable *table, pid_t pid, int depth); // Lists descendants N levels down
+void list_stopped_grandchildren(const ProcessTable *table, pid_t pid);         // Lists stopped grandchildren
+void print_status(const ProcessTable *table, pid_t pid);                       // Prints process status
+void print_subtree_totals(const ProcessTable *table, pid_t pid);               // Sums RSS and CPU over a subtree
+void print_subtree_ranking(const ProcessTable *table, pid_t pid, int top);     // Ranks child subtrees by RSS
+void print_tree(const ProcessTable *table, pid_t pid);                         // Renders the subtree as a pruned tree
+void kill_zombie_parents(const ProcessTable *table, pid_t pid);                // Kills parents of zombies
+void kill_descendants(const ProcessTable *table, pid_t pid);                   // Kills all descendants
+void stop_descendants(const ProcessTable *table, pid_t pid);                   // Stops all descendants
+void continue_descendants(const ProcessTable *table, pid_t pid);               // Continues stopped descendants
+void print_error(const char *msg, int errnum);                                 // Custom error printer
+
+// Function declarations for query dispatch and the long-running daemon
+int parse_query(int argc, char *argv[], Query *query);                         // Parses root, target, option
+int query_fields(const Query *query);                                          // SNAPSHOT_* level a query reads
+int query_plan(const Query *query);                                            // PLAN_* class a query needs
+int run_query(const ProcessTable *table, const Query *query);                  // Answers a query from a snapshot
+int split_query_line(char *line, char *tokens[], int max_tokens);              // Tokenizes one query line
+int run_batch(const char *path);                                               // Answers a file of queries
+int run_daemon(const char *socket_path);                                       // Serves queries from a live table
+int run_client(const char *socket_path, int argc, char *argv[]);               // Sends one query to a daemon
+static int dispatch_query(const ProcessTable *table, const Query *query);      // run_query() without the timer
+static double monotonic_ms(void);                                              // Monotonic clock in milliseconds
+static int pid_map_mark(unsigned char **map, pid_t *size, pid_t pid);          // PID-indexed visited set
+int run_bench(int argc, char *argv[]);                                         // Benchmarks options on synthetic trees
+int run_watch(const Query *query);                                             // Prints subtree changes every tick
+int snapshot_refresh(ProcessTable *next, const ProcessTable *prev, pid_t pid); // Rescan reusing unwatched records
+void stats_report(void);                                                       // Prints --stats at exit
+
+// Output layer: answers are buffered and encoded as text, JSON lines or binary records
+void out_text(const char *fmt, ...) __attribute__((format(printf, 1, 2)));     // Text-mode line(s) only
+void out_record(int kind, const long long *values, const char *text);          // Structured record only
+void out_pid(pid_t pid);                                                       // One listed PID, any format
+void out_flush(void);                                                          // Writes the buffer to stdout
+static void out_cgroup(int count, int value, const char *dir, const char *file); // Records a cgroup fast path
 
 int main(int argc, char *argv[]) {
-    // Ensure correct argument count (3 or 4) for proper execution
-    if (argc < 3 || argc > 4) {
+    // Consume global flags first so only positional arguments remain
+    if (parse_global_flags(&argc, argv) == -1) {
+        return 1; // parse_global_flags already explained the problem
+    }
+    if (run_options.stats) {
+        atexit(stats_report); // Runs however the mode below returns
+    }
+    atexit(out_flush); // Registered last, so answers are written before the --stats report
+
+    // Daemon mode serves until stopped; client mode forwards the positional query to it
+    if (run_options.daemon_socket) {
+        return run_daemon(run_options.daemon_socket); // Serve queries until terminated
+    }
+    if (run_options.connect_socket) {
+        return run_client(run_options.connect_socket, argc - 1, argv + 1); // Forward query to a daemon
+    }
+    if (run_options.batch) {
+        if (argc > 2) {
+            fprintf(stderr, "Error: --batch takes at most one file argument\n"); // Queries come from the file
+            return 1;
+        }
+        return run_batch(argc == 2 ? argv[1] : NULL); // NULL reads queries from stdin
+    }
+    if (run_options.bench) {
+        return run_bench(argc - 1, argv + 1); // Optional shape and sizes follow
+    }
+
+    if (run_options.save_snapshot && argc == 1) { // Capture only; queries can come later with --from-snapshot
+        ProcessTable table;
+        if (snapshot_acquire(&table, NULL) == -1) return 1;
+        snapshot_free(&table);
+        return 0;
+    }
+
+    // Ensure correct argument count (3 to 5) for proper execution
+    if (argc < 3 || argc > 5) {
         fprintf(stderr, "Error: Incorrect number of arguments\n");      // Alert user to argument issue
-        fprintf(stderr, "Usage: %s [root_process] [process_id] [Option]\n", argv[0]); // Show correct format
+        fprintf(stderr, "Usage: %s [--jobs N] [--cgroup] [--stats[=json]] [--format=text|jsonl|bin] [--uring] [root_process] [process_id] [Option [value]]\n", argv[0]); // Show correct format
+        fprintf(stderr, "       %s --daemon SOCKET | --connect SOCKET root_process process_id [Option [value]]\n", argv[0]);
+        fprintf(stderr, "       %s --batch [FILE]\n", argv[0]);
+        fprintf(stderr, "       %s --save-snapshot FILE [root_process process_id [Option [value]]]\n", argv[0]);
+        fprintf(stderr, "       %s --from-snapshot FILE [--batch [FILE] | root_process process_id [Option [value]]]\n", argv[0]);
+        fprintf(stderr, "       %s --bench [wide|deep|zombie|mixed|all] [SIZE...]\n", argv[0]);
         fprintf(stderr, "Example: %s 1234 5678 -id\n", argv[0]);       // Provide a practical example
         return 1;                                                      // Exit with failure code
     }
 
+    Query query; // Parsed root, target and option
+    if (parse_query(argc - 1, argv + 1, &query) == -1) {
+        return 1; // parse_query already reported the problem
+    }
+
+    if (query.option && strcmp(query.option, "-w") == 0 && !run_options.from_snapshot) {
+        if (run_options.ns_inode) {
+            fprintf(stderr, "Error: -w cannot be combined with --ns\n"); // Its rescans take host PIDs
+            return 1;
+        }
+        return run_watch(&query); // Keeps its own snapshots, one per tick
+    }
+
+    // Read only what the option needs from /proc (or map the saved table); every handler below queries it
+    ProcessTable table;
+    if (snapshot_acquire(&table, &query) == -1) {
+        return 1; // snapshot_build already reported the failure
+    }
+
+    int status = run_query(&table, &query); // Dispatch against the snapshot
+    snapshot_free(&table);                  // Release snapshot memory
+    return status;                          // Successful execution unless the query failed
+}
+
+// Parse positional tokens "root_process process_id [Option [value]]" into query
+int parse_query(int argc, char *argv[], Query *query) {
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "Error: Incorrect number of arguments\n"); // Alert user to argument issue
+        return -1;
+    }
+
     // Convert command-line args to PIDs
-    pid_t root_pid = atoi(argv[1]);   // Root of the process tree
-    pid_t target_pid = atoi(argv[2]); // Target process to analyze
-    char *option = (argc == 4) ? argv[3] : NULL; // Optional operation flag
+    query->root_pid = atoi(argv[0]);   // Root of the process tree
+    query->target_pid = atoi(argv[1]); // Target process to analyze
+    query->option = (argc >= 3) ? argv[2] : NULL; // Optional operation flag
+    const char *option_arg = (argc == 4) ? argv[3] : NULL; // Value for options such as -depth N
+
+    // -depth and -w require a value, -agg takes an optional one, every other option takes none
+    int needs_value = query->option && (strcmp(query->option, "-depth") == 0 || strcmp(query->option, "-w") == 0);
+    int is_agg = query->option && strcmp(query->option, "-agg") == 0;
+    query->value = is_agg ? AGG_DEFAULT_TOP : 0;
+    if ((needs_value && !option_arg) || (option_arg && !needs_value && !is_agg)) {
+        fprintf(stderr, "Error: Option '%s' %s a value\n", query->option, needs_value ? "requires" : "does not take"); // Arity mismatch
+        return -1;                                                                                                 // Bad usage
+    }
+    if (option_arg) {
+        char *end;                               // First unparsed character
+        long value = strtol(option_arg, &end, 10); // Parse the level or count strictly
+        if (*option_arg == '\0' || *end != '\0' || value <= 0 || value > 1000000) {
+            fprintf(stderr, "Error: %s expects a positive integer, got '%s'\n", query->option, option_arg); // Reject bad value
+            return -1;
+        }
+        query->value = (int)value;
+    }
+    if (query->option && strcmp(query->option, "-w") == 0 && query->value < 10) {
+        fprintf(stderr, "Error: -w expects an interval of at least 10 ms\n"); // Keep the loop from spinning
+        return -1;
+    }
 
     // Validate that PIDs are positive numbers
-    if (root_pid <= 0 || target_pid <= 0) {
+    if (query->root_pid <= 0 || query->target_pid <= 0) {
         fprintf(stderr, "Error: Process IDs must be positive integers\n"); // Reject invalid PIDs
-        fprintf(stderr, "Got root_pid=%d, target_pid=%d\n", root_pid, target_pid); // Show bad values
-        return 1;                                                         // Exit on invalid input
+        fprintf(stderr, "Got root_pid=%d, target_pid=%d\n", query->root_pid, query->target_pid); // Show bad values
+        return -1;                                                        // Invalid input
+    }
+    return 0;
+}
+
+// Which fields a query reads: extended ones only for options that print them (-sum, -agg, -tree)
+int query_fields(const Query *query) {
+    if (query->option && (strcmp(query->option, "-sum") == 0 || strcmp(query->option, "-agg") == 0 ||
+                          strcmp(query->option, "-tree") == 0)) return SNAPSHOT_EXTENDED;
+    return SNAPSHOT_BASIC; // Everything else needs pid, ppid and state only
+}
+
+// Classify a query by the data it needs; only whole-table queries always list all of /proc
+int query_plan(const Query *query) {
+    const char *option = query->option;
+    if (!option || strcmp(option, "-do") == 0) return PLAN_POINT;
+    if (strcmp(option, "-rp") == 0) return PLAN_ANCESTORS;
+    if (strcmp(option, "-id") == 0) return PLAN_CHILDREN;
+    if (strcmp(option, "-lg") == 0 || strcmp(option, "-lz") == 0) return PLAN_TABLE;
+    return PLAN_SUBTREE; // Unknown options too; dispatch_query() rejects them after the scan
+}
+
+// Split a query line on whitespace in place; stops after max_tokens tokens
+int split_query_line(char *line, char *tokens[], int max_tokens) {
+    int ntokens = 0;
+    char *save;      // strtok_r state; handlers never call strtok
+    for (char *tok = strtok_r(line, " \t\r\n", &save); tok && ntokens < max_tokens; tok = strtok_r(NULL, " \t\r\n", &save)) {
+        tokens[ntokens++] = tok;
+    }
+    return ntokens;
+}
+
+// Answer every "root target [option [value]]" line of path (stdin when NULL) from a single snapshot
+int run_batch(const char *path) {
+    FILE *in = path ? fopen(path, "r") : stdin; // Query source
+    if (!in) {
+        print_error("Cannot open batch file", errno); // Bad path or permissions
+        return 1;
+    }
+
+    ProcessTable table; // One consistent view shared by every query; extended fields load on demand
+    if (snapshot_acquire(&table, NULL) == -1) {
+        if (path) fclose(in);
+        return 1;
+    }
+
+    int status = 0;    // 1 if any query failed
+    char *line = NULL; // getline() buffer, reused for every query
+    size_t line_capacity = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_capacity, in)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0'; // Strip EOL
+        const char *p = line + strspn(line, " \t");
+        if (*p == '\0' || *p == '#') continue; // Skip blanks and comments
+
+        out_text("> %s\n", p);       // Header line separates the answers in the stream
+        out_record(OUT_QUERY, NULL, p);
+        out_flush();                 // Keep headers ordered with handler error output
+
+        char *tokens[5];     // One spare to detect extra arguments
+        int ntokens = split_query_line(line, tokens, 5);
+        Query query;
+        if (parse_query(ntokens, tokens, &query) == -1 || run_query(&table, &query) != 0) {
+            status = 1;      // Keep going; report failure at exit
+        }
+        out_flush();         // Stream each answer as soon as it is complete
+    }
+    free(line);
+    if (path) fclose(in);
+    snapshot_free(&table);
+    return status;
+}
+
+// Answer one query from a snapshot, timing it as the query phase; returns its exit status
+int run_query(const ProcessTable *table, const Query *query) {
+    double started = monotonic_ms();
+    Query scoped = *query;                     // With --ns, PIDs as the namespace numbers them
+    if (table->ns_pid) {
+        scoped.root_pid = ns_host_pid(table, query->root_pid);
+        scoped.target_pid = ns_host_pid(table, query->target_pid);
+        if (!scoped.root_pid || !scoped.target_pid) {
+            fprintf(stderr, "Error: No process %d in PID namespace %llu\n",
+                    scoped.root_pid ? query->target_pid : query->root_pid, run_options.ns_inode);
+            phase_ms[PHASE_QUERY] += monotonic_ms() - started;
+            return 1;
+        }
     }
+    int status = dispatch_query(table, &scoped); // Validate the tree, then run the option
+    phase_ms[PHASE_QUERY] += monotonic_ms() - started;
+    return status;
+}
+
+// Check root and target, then hand the query to its option's handler
+static int dispatch_query(const ProcessTable *table, const Query *query) {
+    pid_t root_pid = query->root_pid;     // Root of the process tree
+    pid_t target_pid = query->target_pid; // Target process to analyze
+    const char *option = query->option;   // Optional operation flag
 
     // Verify root process exists before proceeding
-    ProcessInfo root_info = get_process_info(root_pid);
-    if (root_info.pid == 0) {
+    if (!snapshot_find(table, root_pid)) {
         fprintf(stderr, "Error: Root process %d does not exist or is inaccessible\n", root_pid); // Root not found
         return 1;                                                                       // Abort if root invalid
     }
 
+    // A saved table can be read, but signals and watching need the processes themselves
+    if (run_options.from_snapshot && option && (strcmp(option, "-w") == 0 || (strcmp(option, "--pz") == 0 && !run_options.dry_run) ||
+        strcmp(option, "-sk") == 0 || strcmp(option, "-st") == 0 || strcmp(option, "-dt") == 0 || strcmp(option, "-rp") == 0)) {
+        fprintf(stderr, "Error: %s acts on live processes and cannot run against --from-snapshot\n", option);
+        return 1;
+    }
+
+    // A parent cycle means the scan saw a recycled PID; answers for this target may be partial
+    int target_slot = snapshot_slot(table, target_pid);
+    if (target_slot >= 0 && table->depth[target_slot] == DEPTH_CYCLE) {
+        fprintf(stderr, "Warning: Parent links of process %d form a cycle (PID reused during the scan)\n", target_pid);
+    }
+
     // Check if target is in the tree rooted at root_pid
-    if (!is_in_tree(root_pid, target_pid)) {
+    if (!is_in_tree(table, root_pid, target_pid)) {
         if (option) {
-            printf("Notice: Process %d does not belong to the tree rooted at %d\n", target_pid, root_pid); // Inform user
+            out_text("Notice: Process %d does not belong to the tree rooted at %d\n", target_pid, root_pid); // Inform user
+            out_record(OUT_NOT_IN_TREE, (long long[]){target_pid, root_pid}, NULL);
         }
         return 0; // Exit silently if no option, or with notice if option provided
     }
 
     // Handle no-option case: just print basic info
     if (!option) {
-        print_basic_info(target_pid); // Display PID and PPID of target
-        return 0;                    // Done, exit cleanly
-    }
-
-    // Process the provided option with a series of checks
-    if (strcmp(option, "-dc") == 0) {
-        int count = count_defunct_descendants(target_pid); // Count zombies
+        print_basic_info(table, target_pid); // Display PID and PPID of target
+    } else if (strcmp(option, "-dc") == 0) {
+        int count = count_defunct_descendants(table, target_pid); // Count zombies
         if (count >= 0) {
-            printf("Number of defunct descendants: %d\n", count); // Output result if successful
+            out_text("Number of defunct descendants: %d\n", count); // Output result if successful
+            out_record(OUT_DEFUNCT_COUNT, (long long[]){target_pid, count}, NULL);
         }
     } else if (strcmp(option, "-ds") == 0) {
-        list_non_direct_descendants(target_pid, target_pid); // List deeper descendants
+        list_non_direct_descendants(table, target_pid); // List deeper descendants
     } else if (strcmp(option, "-id") == 0) {
-        list_immediate_descendants(target_pid); // List direct children
+        list_immediate_descendants(table, target_pid); // List direct children
     } else if (strcmp(option, "-lg") == 0) {
-        list_siblings(target_pid); // List processes at same level
+        list_siblings(table, target_pid); // List processes at same level
     } else if (strcmp(option, "-lz") == 0) {
-        list_defunct_siblings(target_pid); // List zombie siblings only
+        list_defunct_siblings(table, target_pid); // List zombie siblings only
     } else if (strcmp(option, "-df") == 0) {
-        list_defunct_descendants(target_pid); // Show all zombie descendants
+        list_defunct_descendants(table, target_pid); // Show all zombie descendants
     } else if (strcmp(option, "-gc") == 0) {
-        list_grandchildren(target_pid); // Display second-level descendants
+        list_grandchildren(table, target_pid); // Display second-level descendants
+    } else if (strcmp(option, "-depth") == 0) {
+        list_descendants_at_depth(table, target_pid, query->value); // Display Nth-level descendants
+    } else if (strcmp(option, "-sg") == 0) {
+        list_stopped_grandchildren(table, target_pid); // Second-level descendants in state T
     } else if (strcmp(option, "-do") == 0) {
-        print_status(target_pid); // Show if process is defunct
+        print_status(table, target_pid); // Show if process is defunct
+    } else if (strcmp(option, "-sum") == 0) {
+        print_subtree_totals(table, target_pid); // Total RSS and CPU of the subtree
+    } else if (strcmp(option, "-agg") == 0) {
+        print_subtree_ranking(table, target_pid, query->value); // Heaviest child subtrees
+    } else if (strcmp(option, "-tree") == 0) {
+        print_tree(table, target_pid); // Indented subtree, pruned by --max-depth and --top
+    } else if (strcmp(option, "-w") == 0) {
+        fprintf(stderr, "Error: -w runs only as a one-shot command, not in batch or daemon mode\n"); // Needs its own snapshots
+        return 1;
     } else if (strcmp(option, "--pz") == 0) {
-        kill_zombie_parents(target_pid); // Terminate parents of zombies
+        kill_zombie_parents(table, target_pid); // Terminate parents of zombies
     } else if (strcmp(option, "-sk") == 0) {
-        kill_descendants(target_pid); // Kill all descendants
+        kill_descendants(table, target_pid); // Kill all descendants
     } else if (strcmp(option, "-st") == 0) {
-        stop_descendants(target_pid); // Pause descendants
+        stop_descendants(table, target_pid); // Pause descendants
     } else if (strcmp(option, "-dt") == 0) {
-        continue_descendants(target_pid); // Resume stopped descendants
+        continue_descendants(table, target_pid); // Resume stopped descendants
     } else if (strcmp(option, "-rp") == 0) {
         if (kill(root_pid, SIGKILL) == -1) { // Attempt to kill root process
             print_error("Failed to kill root process", errno); // Report failure
         } else {
-            printf("Root process %d terminated successfully\n", root_pid); // Confirm success
+            out_text("Root process %d terminated successfully\n", root_pid); // Confirm success
+            out_record(OUT_SIGNALLED, (long long[]){root_pid, SIGKILL}, NULL);
         }
     } else {
         fprintf(stderr, "Error: Invalid option '%s'\n", option); // Unknown option error
-        fprintf(stderr, "Valid options: -dc, -ds, -id, -lg, -lz, -df, -gc, -do, --pz, -sk, -st, -dt, -rp\n"); // List all options
+        fprintf(stderr, "Valid options: -dc, -ds, -id, -lg, -lz, -df, -gc, -sg, -depth N, -do, -sum, -agg [K], -tree, -w MS, --pz, -sk, -st, -dt, -rp\n"); // List all options
         return 1; // Exit with error
     }
+    return 0; // Query answered
+}
 
-    return 0; // Successful execution
+// Milliseconds on the monotonic clock, for phase and per-round timing
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
 }
 
 // Custom error reporting function with detailed message
@@ -123,391 +726,3761 @@ void print_error(const char *msg, int errnum) {
     fprintf(stderr, "Error: %s: %s\n", msg, strerror(errnum)); // Combine custom message with system error
 }
 
+// Print the --stats counters and phase timers to stderr, as text or one JSON object
+void stats_report(void) {
+    ScanCounters c = scan_counters; // Workers have all been joined by now
+    if (run_options.stats == STATS_JSON) {
+        fprintf(stderr, "{\"syscalls\":%lu,\"stat_reads\":%lu,\"dir_scans\":%lu,\"tree_checks\":%lu,\"phases_ms\":{",
+                c.syscalls, c.stat_reads, c.dir_scans, c.tree_checks);
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            fprintf(stderr, "%s\"%s\":%.3f", i ? "," : "", phase_names[i], phase_ms[i]);
+        }
+        fprintf(stderr, "}}\n");
+        return;
+    }
+    fprintf(stderr, "Stats: %lu syscalls, %lu stat reads, %lu /proc scans, %lu tree checks\n",
+            c.syscalls, c.stat_reads, c.dir_scans, c.tree_checks);
+    fprintf(stderr, "Phases (ms):");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(stderr, " %s %.3f", phase_names[i], phase_ms[i]);
+    }
+    fprintf(stderr, "\n");
+}
+
 // Retrieve process details from /proc filesystem
 ProcessInfo get_process_info(pid_t pid) {
-    ProcessInfo info = {0, 0, ' '}; // Initialize with zeroes and blank state
+    return get_process_record(pid, NULL); // pid, ppid and state only
+}
+
+// Read /proc/[pid]/stat into buf with one open/pread/close; returns the length, or -1 if unreadable
+static ssize_t read_stat_file(pid_t pid, char *buf, size_t size) {
     char path[32];                  // Buffer for /proc path
-    snprintf(path, sizeof(path), "/proc/%d/stat", pid); // Construct path to stat file
+    char digits[12];                // PID digits, written backwards
+    int n = 0;                      // Number of digits produced
+    unsigned int value = (unsigned int)pid;
+    do {
+        digits[n++] = (char)('0' + value % 10); // Emit lowest digit
+        value /= 10;
+    } while (value && n < (int)sizeof(digits));
+    memcpy(path, "/proc/", 6);                    // Prefix
+    for (int i = 0; i < n; i++) path[6 + i] = digits[n - 1 - i]; // PID in reading order
+    memcpy(path + 6 + n, "/stat", 6);             // Suffix plus terminator
 
-    FILE *fp = fopen(path, "r"); // Open process stat file
-    if (!fp) {
-        return info; // Return empty info if file inaccessible (e.g., no perms)
+    int fd = open(path, O_RDONLY | O_CLOEXEC); // Open process stat file
+    COUNT(syscalls, 1);
+    if (fd == -1) {
+        return -1; // File inaccessible (e.g., no perms) or process gone
     }
 
-    // Read PID, skip command, get state and PPID
-    if (fscanf(fp, "%d %*s %c %d", &info.pid, &info.state, &info.ppid) != 3) {
-        fclose(fp);  // Close file on read failure
-        return info; // Return empty if parsing fails
+    ssize_t len = pread(fd, buf, size - 1, 0); // One read covers every field we use
+    close(fd);                                 // Clean up file descriptor
+    COUNT(syscalls, 2);
+    COUNT(stat_reads, 1);
+    return len;
+}
+
+// Read /proc/[pid]/stat once; also fill ext from the same line when it is not NULL
+ProcessInfo get_process_record(pid_t pid, ProcessExt *ext) {
+    ProcessInfo info = {0, 0, ' ', 0}; // Initialize with zeroes, blank state and unknown start
+    char buf[1024];                    // Stat line lives on the stack
+    ssize_t len = read_stat_file(pid, buf, sizeof(buf));
+    if (len <= 0 || parse_stat_line(buf, (size_t)len, &info) == -1) {
+        info.pid = 0; // Return empty if reading or parsing fails
+    } else if (ext && parse_stat_ext(buf, (size_t)len, ext) == 0) {
+        ext->loaded = 1; // Extended fields come from the same read
     }
-    fclose(fp);      // Clean up file handle
-    return info;     // Return populated info
+    return info;      // Return populated info
 }
 
-// Determine if target_pid is in the tree rooted at root_pid
-int is_in_tree(pid_t root_pid, pid_t target_pid) {
-    if (root_pid == target_pid) return 1; // Base case: same process
+// Parse "pid (comm) state ppid ..." without stdio; comm may contain spaces and ')'
+int parse_stat_line(const char *buf, size_t len, ProcessInfo *info) {
+    const char *end = buf + len; // One past the last byte read
+    const char *p = buf;         // Parse cursor
 
-    ProcessInfo info = get_process_info(target_pid); // Get target’s info
-    if (info.pid == 0) return 0;                    // Target doesn’t exist
+    pid_t pid = 0; // Leading PID field
+    while (p < end && *p >= '0' && *p <= '9') pid = pid * 10 + (*p++ - '0');
+    if (p == buf || p == end || *p != ' ') return -1; // PID must be followed by " (comm)"
 
-    pid_t current = info.ppid; // Start at parent
-    int iterations = 0;        // Counter to avoid infinite loops
-    while (current != 0 && iterations++ < 1000) { // Traverse up to root or limit
-        if (current == root_pid) return 1;        // Found root in chain
-        info = get_process_info(current);         // Move to next parent
-        current = info.ppid;                      // Update current PID
+    const char *close_paren = NULL; // comm ends at the last ')' on the line
+    for (const char *q = end; q > p; q--) {
+        if (q[-1] == ')') {
+            close_paren = q - 1;
+            break;
+        }
     }
-    return 0; // Root not found in chain
-}
+    if (!close_paren || end - close_paren < 4) return -1; // Need ") S ppid" after comm
 
-// Display basic process info for no-option case
-void print_basic_info(pid_t pid) {
-    ProcessInfo info = get_process_info(pid); // Fetch process details
-    if (info.pid == 0) {
-        fprintf(stderr, "Error: Cannot get information for process %d\n", pid); // Alert if inaccessible
-        return;
+    p = close_paren + 1;                 // Expect " state ppid"
+    if (*p++ != ' ') return -1;
+    char state = *p++;                   // Single-character process state
+    if (p >= end || *p++ != ' ') return -1;
+
+    pid_t ppid = 0; // Parent PID field
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9') ppid = ppid * 10 + (*p++ - '0');
+    if (p == digits) return -1; // PPID must be present
+
+    unsigned long long starttime = 0; // Field 22; left 0 (unknown) if the line is cut short
+    for (int field = 5; field < 22 && p < end; field++) { // Skip pgrp (5) through itrealvalue (21)
+        while (p < end && *p == ' ') p++;
+        while (p < end && *p != ' ') p++;
     }
-    printf("PID: %d, PPID: %d\n", info.pid, info.ppid); // Print requested info
+    while (p < end && *p == ' ') p++;
+    while (p < end && *p >= '0' && *p <= '9') starttime = starttime * 10 + (unsigned long long)(*p++ - '0');
+
+    info->pid = pid;     // Commit parsed fields
+    info->ppid = ppid;
+    info->state = state;
+    info->starttime = starttime;
+    return 0;
 }
 
-// Count zombie processes in the tree
-int count_defunct_descendants(pid_t pid) {
-    int count = 0; // Initialize zombie counter
-    DIR *dir = opendir("/proc"); // Open process directory
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Report dir access failure
-        return -1;                                           // Indicate error
+// Parse comm and the numeric fields after ppid (pgrp through rss) of a stat line into ext
+int parse_stat_ext(const char *buf, size_t len, ProcessExt *ext) {
+    const char *end = buf + len;                  // One past the last byte read
+    const char *open_paren = memchr(buf, '(', len); // comm starts after the first '('
+    const char *close_paren = NULL;               // ... and ends at the last ')'
+    for (const char *q = end; q > buf; q--) {
+        if (q[-1] == ')') {
+            close_paren = q - 1;
+            break;
+        }
     }
+    if (!open_paren || !close_paren || close_paren < open_paren) return -1;
+    size_t n = (size_t)(close_paren - open_paren - 1);
+    if (n > sizeof(ext->comm) - 1) n = sizeof(ext->comm) - 1;
+    memcpy(ext->comm, open_paren + 1, n);
+    ext->comm[n] = '\0';
 
-    struct dirent *entry; // Directory entry pointer
-    while ((entry = readdir(dir)) != NULL) { // Iterate through /proc
-        if (!isdigit(*entry->d_name)) continue; // Skip non-numeric entries
-        pid_t curr_pid = atoi(entry->d_name);  // Convert name to PID
-        ProcessInfo info = get_process_info(curr_pid); // Get process info
-        if (info.pid == 0) continue;                  // Skip if process vanished
-        if (is_in_tree(pid, curr_pid) && info.state == 'Z') { // Check tree and zombie state
-            count++;                                          // Increment for each zombie
-        }
+    unsigned long long field[25] = {0}; // field[k] is stat(5) field k; non-numeric ones stay 0
+    int k = 3;                          // The first field after comm is the state
+    const char *p = close_paren + 1;
+    while (k <= 24) {
+        while (p < end && *p == ' ') p++;
+        if (p >= end || *p == '\n') break;                      // Line ended early
+        int negative = *p == '-';                               // tty_nr, priority and nice can be
+        if (negative) p++;
+        unsigned long long value = 0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (unsigned long long)(*p++ - '0');
+        while (p < end && *p != ' ' && *p != '\n') p++;          // Skip the rest of a token such as the state
+        field[k++] = negative ? 0 : value;
     }
-    closedir(dir); // Release directory handle
-    return count;  // Return total zombies found
+    if (k <= 24) return -1; // rss is field 24
+
+    ext->pgrp = (pid_t)field[5];
+    ext->session = (pid_t)field[6];
+    ext->utime = (unsigned long)field[14];
+    ext->stime = (unsigned long)field[15];
+    ext->num_threads = (int)field[20];
+    ext->starttime = field[22];
+    ext->rss = (long)field[24];
+    return 0;
 }
 
-// List processes deeper than direct children
-void list_non_direct_descendants(pid_t pid, pid_t parent) {
-    DIR *dir = opendir("/proc"); // Access process list
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Handle dir open error
-        return;
+// Pick num_threads (field 20) out of a stat line without parsing the other extended fields; 0 if absent
+static int parse_stat_threads(const char *buf, size_t len) {
+    const char *end = buf + len;
+    const char *p = NULL; // Just past comm's closing ')'
+    for (const char *q = end; q > buf && !p; q--) {
+        if (q[-1] == ')') p = q;
     }
-
-    struct dirent *entry; // Entry for iteration
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Ignore non-PID entries
-        pid_t curr_pid = atoi(entry->d_name);  // Parse PID
-        ProcessInfo info = get_process_info(curr_pid); // Fetch details
-        if (info.pid == 0) continue;                  // Skip missing processes
-        // Print if in tree, not direct child, and not the root
-        if (is_in_tree(pid, curr_pid) && info.ppid != parent && curr_pid != pid) {
-            printf("%d\n", curr_pid);
-        }
+    if (!p) return 0;
+    for (int field = 3; field < 20; field++) { // Skip state (3) through nice (19)
+        while (p < end && *p == ' ') p++;
+        while (p < end && *p != ' ') p++;
     }
-    closedir(dir); // Clean up
+    while (p < end && *p == ' ') p++;
+    int threads = 0;
+    while (p < end && *p >= '0' && *p <= '9') threads = threads * 10 + (*p++ - '0');
+    return threads;
 }
 
-// Show immediate children of the process
-void list_immediate_descendants(pid_t pid) {
-    DIR *dir = opendir("/proc"); // Open /proc for scanning
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Dir access failed
-        return;
+// One stat read for the subtree walk: ext as well when fields is SNAPSHOT_EXTENDED, otherwise just
+// the thread count read_children() needs, taken from the same line
+static ProcessInfo walk_record(pid_t pid, int fields, ProcessExt *ext, int *threads) {
+    ProcessInfo info = {0, 0, ' ', 0};
+    char buf[1024];
+    ssize_t len = read_stat_file(pid, buf, sizeof(buf));
+    *threads = 0;
+    if (len <= 0 || parse_stat_line(buf, (size_t)len, &info) == -1) {
+        info.pid = 0; // Gone or unreadable
+    } else if (fields == SNAPSHOT_EXTENDED) {
+        if (parse_stat_ext(buf, (size_t)len, ext) == 0) ext->loaded = 1;
+        *threads = ext->num_threads;
+    } else {
+        *threads = parse_stat_threads(buf, (size_t)len);
     }
+    return info;
+}
 
-    struct dirent *entry; // Directory iterator
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Filter out non-PIDs
-        pid_t curr_pid = atoi(entry->d_name);  // Extract PID
-        ProcessInfo info = get_process_info(curr_pid); // Get process data
-        if (info.pid == 0) continue;                  // Skip if not found
-        if (info.ppid == pid) {                       // Direct child check
-            printf("%d\n", curr_pid);                 // Output child PID
+// Remove recognised global flags from argv, leaving the positional arguments in place
+int parse_global_flags(int *argc, char *argv[]) {
+    int kept = 1; // argv[0] always stays
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "Error: --jobs requires a thread count\n"); // Missing value
+                return -1;
+            }
+            char *end;                                  // First unparsed character
+            long jobs = strtol(argv[++i], &end, 10);    // 0 means one thread per online CPU
+            if (*argv[i] == '\0' || *end != '\0' || jobs < 0 || jobs > 1024) {
+                fprintf(stderr, "Error: --jobs expects an integer between 0 and 1024, got '%s'\n", argv[i]);
+                return -1;
+            }
+            if (jobs == 0) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN); // Size the pool to the host
+                jobs = cpus > 0 ? cpus : 1;
+            }
+            run_options.jobs = (int)jobs;
+        } else if (strcmp(argv[i], "--daemon") == 0 || strcmp(argv[i], "--connect") == 0) {
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "Error: %s requires a socket path\n", argv[i]); // Missing value
+                return -1;
+            }
+            if (argv[i][2] == 'd') run_options.daemon_socket = argv[i + 1]; // Serve on this path
+            else run_options.connect_socket = argv[i + 1];                  // Query this path
+            i++;
+        } else if (strcmp(argv[i], "--save-snapshot") == 0 || strcmp(argv[i], "--from-snapshot") == 0) {
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "Error: %s requires a file path\n", argv[i]); // Missing value
+                return -1;
+            }
+            if (argv[i][2] == 's') run_options.save_snapshot = argv[i + 1]; // Capture to this file
+            else run_options.from_snapshot = argv[i + 1];                  // Replay from this file
+            i++;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            run_options.batch = 1; // Optional FILE stays behind as a positional argument
+        } else if (strcmp(argv[i], "--cgroup") == 0) {
+            run_options.cgroup = 1; // Allow the cgroup v2 fast path for -sk, -st and -dt
+        } else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=text") == 0) {
+            run_options.stats = STATS_TEXT; // Human-readable report on stderr
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            run_options.stats = STATS_JSON; // One JSON object on stderr
+        } else if (strncmp(argv[i], "--format=", 9) == 0) {
+            const char *format = argv[i] + 9;
+            if (strcmp(format, "text") == 0) run_options.format = FORMAT_TEXT;
+            else if (strcmp(format, "jsonl") == 0) run_options.format = FORMAT_JSONL;
+            else if (strcmp(format, "bin") == 0) run_options.format = FORMAT_BIN;
+            else {
+                fprintf(stderr, "Error: --format expects text, jsonl or bin, got '%s'\n", format);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--min-zombies") == 0) {
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "Error: --min-zombies requires a count\n"); // Missing value
+                return -1;
+            }
+            char *end;                                        // First unparsed character
+            long min = strtol(argv[++i], &end, 10);           // No parent has more than PID_MAX_LIMIT children
+            if (*argv[i] == '\0' || *end != '\0' || min < 1 || min > PID_MAX_LIMIT) {
+                fprintf(stderr, "Error: --min-zombies expects a positive integer, got '%s'\n", argv[i]);
+                return -1;
+            }
+            run_options.min_zombies = (int)min;
+        } else if (strcmp(argv[i], "--ns") == 0) {
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "Error: --ns requires a namespace inode or a PID\n"); // Missing value
+                return -1;
+            }
+            const char *arg = argv[++i];
+            if (strncmp(arg, "pid:[", 5) == 0) arg += 5;        // Accept readlink's "pid:[4026531836]" too
+            char *end;                                          // First unparsed character
+            unsigned long long value = strtoull(arg, &end, 10);
+            if (*arg < '0' || *arg > '9' || (*end != '\0' && strcmp(end, "]") != 0) || value == 0) {
+                fprintf(stderr, "Error: --ns expects a namespace inode or a PID, got '%s'\n", argv[i]);
+                return -1;
+            }
+            if (value <= PID_MAX_LIMIT) {                       // A PID: scope to the namespace it lives in
+                run_options.ns_inode = pid_ns_inode((pid_t)value);
+                if (!run_options.ns_inode) {
+                    fprintf(stderr, "Error: Cannot read the PID namespace of process %llu: %s\n", value, strerror(errno));
+                    return -1;
+                }
+            } else {
+                run_options.ns_inode = value;
+            }
+        } else if (strcmp(argv[i], "--max-depth") == 0 || strcmp(argv[i], "--top") == 0) {
+            int depth = argv[i][2] == 'm';
+            if (i + 1 >= *argc) {
+                fprintf(stderr, "Error: %s requires a count\n", argv[i]); // Missing value
+                return -1;
+            }
+            char *end;                                        // First unparsed character
+            long value = strtol(argv[i + 1], &end, 10);
+            if (*argv[i + 1] == '\0' || *end != '\0' || value < !depth || value > PID_MAX_LIMIT) {
+                fprintf(stderr, "Error: %s expects an integer of at least %d, got '%s'\n", argv[i], !depth, argv[i + 1]);
+                return -1;
+            }
+            if (depth) run_options.max_depth = (int)value; // 0 shows the target alone
+            else run_options.top = (int)value;
+            i++;
+        } else if (strcmp(argv[i], "--rank=procs") == 0) {
+            run_options.rank = RANK_PROCS; // Largest subtrees first
+        } else if (strcmp(argv[i], "--rank=rss") == 0) {
+            run_options.rank = RANK_RSS;   // Most resident memory first
+        } else if (strcmp(argv[i], "--dry-run") == 0) {
+            run_options.dry_run = 1; // --pz only lists
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            run_options.verbose = 1; // Per-PID lines from -sk, -st and -dt
+        } else if (strcmp(argv[i], "--uring") == 0) {
+            run_options.uring = 1; // Batched stat reads; falls back on its own if the kernel refuses
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            run_options.bench = 1;  // Shape and sizes stay behind as positional arguments
+        } else {
+            argv[kept++] = argv[i]; // Positional argument or option; keep in order
         }
     }
-    closedir(dir); // Close directory
+    *argc = kept;       // Report the compacted count
+    argv[kept] = NULL;  // Keep argv NULL-terminated
+    if (run_options.from_snapshot && (run_options.save_snapshot || run_options.daemon_socket ||
+                                      run_options.connect_socket || run_options.bench)) {
+        fprintf(stderr, "Error: --from-snapshot works only with one-shot queries and --batch\n"); // Those modes read /proc
+        return -1;
+    }
+    if (run_options.ns_inode && (run_options.from_snapshot || run_options.daemon_socket ||
+                                 run_options.connect_socket || run_options.bench)) {
+        fprintf(stderr, "Error: --ns works only with one-shot queries, --batch and --save-snapshot\n"); // They scan this host's /proc
+        return -1;
+    }
+    return 0;
 }
 
-// List processes sharing the same parent
-void list_siblings(pid_t pid) {
-    ProcessInfo info = get_process_info(pid); // Get target’s parent info
-    if (info.pid == 0) {
-        fprintf(stderr, "Error: Cannot get information for process %d\n", pid); // Target inaccessible
-        return;
+// Record layout returned by getdents64(2); glibc does not export it
+struct linux_dirent64 {
+    uint64_t d_ino;          // Inode number
+    int64_t d_off;           // Offset to the next record
+    unsigned short d_reclen; // Length of this record
+    unsigned char d_type;    // File type (DT_DIR for /proc/[pid])
+    char d_name[];           // NUL-terminated entry name
+};
+
+// Parse a /proc entry name as a PID; 0 unless it is all digits and fits in pid_t
+pid_t parse_pid_name(const char *name) {
+    if (*name < '1' || *name > '9') return 0; // No sign, no leading zero, not empty
+    long value = 0;
+    for (const char *p = name; *p; p++) {
+        if (*p < '0' || *p > '9') return 0;  // Rejects names like "12abc"
+        value = value * 10 + (*p - '0');
+        if (value > 0x7fffffff) return 0;    // Would overflow pid_t
     }
+    return (pid_t)value;
+}
 
-    DIR *dir = opendir("/proc"); // Open process directory
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Report access issue
-        return;
+// List every PID directory in /proc into a malloc'd dense array; returns the count or -1
+int enumerate_pids(pid_t **pids) {
+    *pids = NULL; // Nothing allocated yet
+    int fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC); // Open process directory
+    COUNT(dir_scans, 1);
+    COUNT(syscalls, 2); // open plus the final close
+    if (fd == -1) {
+        print_error("Cannot access /proc directory", errno); // Report dir access failure
+        return -1;                                           // Indicate error
+    }
+
+    enum { DENTS_BUFFER = 64 * 1024 };  // Hundreds of entries per syscall
+    char *buf = malloc(DENTS_BUFFER);   // Raw getdents64 records
+    int count = 0, capacity = 0;        // Filled and allocated entries
+    if (!buf) {
+        print_error("Cannot allocate directory buffer", errno); // Out of memory
+        close(fd);
+        return -1;
     }
 
-    struct dirent *entry; // Iterate through processes
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Skip non-numeric
-        pid_t curr_pid = atoi(entry->d_name);  // Parse PID
-        if (curr_pid == pid) continue;         // Exclude self
-        ProcessInfo curr_info = get_process_info(curr_pid); // Get sibling info
-        if (curr_info.ppid == info.ppid) {                  // Same parent check
-            printf("%d\n", curr_pid);                       // Print sibling PID
+    for (;;) {
+        long nread = syscall(SYS_getdents64, fd, buf, DENTS_BUFFER); // Fetch a batch of entries
+        COUNT(syscalls, 1);
+        if (nread == -1) {
+            print_error("Cannot read /proc directory", errno); // Directory read failed
+            free(*pids);
+            *pids = NULL;
+            count = -1;
+            break;
+        }
+        if (nread == 0) break; // End of directory
+
+        for (long off = 0; off < nread;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+            off += d->d_reclen; // Advance before any continue
+            if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN) continue; // PIDs are directories
+            pid_t pid = parse_pid_name(d->d_name);                       // Strict numeric check
+            if (pid == 0) continue;                                      // Skip non-PID entries
+
+            if (count == capacity) { // Grow PID array geometrically
+                int new_capacity = capacity ? capacity * 2 : 1024;
+                pid_t *grown = realloc(*pids, new_capacity * sizeof(pid_t));
+                if (!grown) {
+                    print_error("Cannot allocate PID list", errno); // Out of memory
+                    free(buf);
+                    free(*pids);
+                    *pids = NULL;
+                    close(fd);
+                    return -1;
+                }
+                *pids = grown;
+                capacity = new_capacity;
+            }
+            (*pids)[count++] = pid; // Append to dense list
         }
     }
-    closedir(dir); // Free dir resource
+    free(buf); // Release record buffer
+    close(fd); // Release directory handle
+    if (count > 0 && run_options.ns_inode) count = ns_filter_pids(*pids, count, run_options.ns_inode); // --ns scope
+    return count; // Number of PIDs listed
 }
 
-// List only zombie siblings
-void list_defunct_siblings(pid_t pid) {
-    ProcessInfo info = get_process_info(pid); // Fetch target process details
-    if (info.pid == 0) {
-        fprintf(stderr, "Error: Cannot get information for process %d\n", pid); // Error if not found
-        return;
+// ---------------------------------------------------------------------------
+// PID namespaces (--ns): a full scan keeps only the processes whose
+// /proc/[pid]/ns/pid is the chosen namespace, one stat() each, before any stat
+// file is read. Members' NSpid lines then map the query's PIDs, which are the
+// container's own, onto host PIDs.
+// ---------------------------------------------------------------------------
+
+// Inode of pid's PID namespace, the number in readlink's "pid:[N]"; 0 with errno set if unreadable
+unsigned long long pid_ns_inode(pid_t pid) {
+    char path[40];
+    struct stat st;
+    snprintf(path, sizeof(path), "/proc/%d/ns/pid", pid);
+    COUNT(syscalls, 1);
+    if (stat(path, &st) == -1) return 0; // Gone, or another user's process without CAP_SYS_PTRACE
+    return (unsigned long long)st.st_ino;
+}
+
+// Last field of the NSpid line in /proc/[pid]/status: pid as its innermost namespace sees it; 0 if unknown
+pid_t read_ns_pid(pid_t pid) {
+    char path[40];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    COUNT(syscalls, 1);
+    if (fd == -1) return 0;
+
+    char buf[4096];                                   // NSpid sits well inside the first page
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    close(fd);
+    COUNT(syscalls, 2);
+    if (len <= 0) return 0;
+    buf[len] = '\0';
+    char *line = strstr(buf, "\nNSpid:");             // Linux 4.1+
+    if (!line) return 0;
+
+    pid_t last = 0;
+    for (char *p = line + 7; *p && *p != '\n';) {     // Tab-separated, outermost namespace first
+        while (*p == '\t' || *p == ' ') p++;
+        if (*p < '0' || *p > '9') break;
+        last = 0;
+        while (*p >= '0' && *p <= '9') last = last * 10 + (*p++ - '0');
     }
+    return last;
+}
 
-    DIR *dir = opendir("/proc"); // Access /proc filesystem
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Dir error
-        return;
+// Compact pids[0 .. n) to the members of namespace inode, in order; returns how many remain
+int ns_filter_pids(pid_t *pids, int n, unsigned long long inode) {
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (pid_ns_inode(pids[i]) == inode) pids[kept++] = pids[i];
     }
+    return kept;
+}
 
-    struct dirent *entry; // Directory entry iterator
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Ignore non-PIDs
-        pid_t curr_pid = atoi(entry->d_name);  // Convert to PID
-        if (curr_pid == pid) continue;         // Skip target itself
-        ProcessInfo curr_info = get_process_info(curr_pid); // Get sibling data
-        if (curr_info.ppid == info.ppid && curr_info.state == 'Z') { // Check sibling and zombie
-            printf("%d\n", curr_pid);                                // Print zombie sibling
-        }
+// Host PID of the member that is local inside the scanned namespace; 0 if none is
+static pid_t ns_host_pid(const ProcessTable *table, pid_t local) {
+    for (int i = 0; i < table->count; i++) {
+        if (table->ns_pid[i] == local) return table->procs[i].pid;
     }
-    closedir(dir); // Clean up directory
+    return 0;
 }
 
-// List all zombie descendants except the target
-void list_defunct_descendants(pid_t pid) {
-    DIR *dir = opendir("/proc"); // Open process info directory
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Handle open failure
-        return;
+// One worker's share of the parse phase: a PID range and the disjoint output region it owns
+typedef struct {
+    const pid_t *pids; // First PID of this chunk
+    int n;             // Number of PIDs in the chunk
+    ProcessInfo *out;  // Output region with room for n records; touched by this worker only
+    int parsed;        // Records actually written (vanished processes are dropped)
+    ProcessExt *ext;   // Parallel to out for SNAPSHOT_EXTENDED scans, else NULL
+} ParseChunk;
+
+static int uring_parse_chunk(ParseChunk *chunk); // io_uring reader; -1 means use the synchronous loop
+
+// Parse every PID in a chunk; runs on a worker thread or inline
+static void *parse_chunk(void *arg) {
+    ParseChunk *chunk = arg;
+    if (run_options.uring && uring_parse_chunk(chunk) == 0) return NULL; // Whole chunk read through the ring
+    chunk->parsed = 0;
+    for (int i = 0; i < chunk->n; i++) {
+        ProcessExt *ext = chunk->ext ? &chunk->ext[chunk->parsed] : NULL; // Filled from the same read
+        ProcessInfo info = get_process_record(chunk->pids[i], ext); // Read this process once
+        if (info.pid == 0) continue;                         // Skip if process vanished
+        chunk->out[chunk->parsed++] = info;                  // Store record
     }
+    return NULL;
+}
+
+// Scan /proc exactly once and store every readable process in table; fields is a SNAPSHOT_* level
+int snapshot_build(ProcessTable *table, int fields) {
+    memset(table, 0, sizeof(*table)); // Start from an empty table
+
+    pid_t *pids;                   // Dense list of candidate PIDs
+    double phase_start = monotonic_ms();
+    int npids = enumerate_pids(&pids);
+    phase_ms[PHASE_ENUMERATE] += monotonic_ms() - phase_start;
+    if (npids == -1) return -1;    // enumerate_pids already reported the failure
+    phase_start = monotonic_ms();  // Parse phase: allocation, workers and merge
 
-    struct dirent *entry; // Iterator for /proc entries
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Skip non-numeric entries
-        pid_t curr_pid = atoi(entry->d_name);  // Parse PID
-        ProcessInfo info = get_process_info(curr_pid); // Fetch process info
-        if (info.pid == 0) continue;                  // Skip if not found
-        // Check if descendant, zombie, and not target
-        if (is_in_tree(pid, curr_pid) && info.state == 'Z' && curr_pid != pid) {
-            printf("%d\n", curr_pid);                 // Output zombie PID
+    table->procs = malloc(((size_t)npids + 1) * sizeof(ProcessInfo)); // At most one record per PID
+    if (!table->procs) {
+        print_error("Cannot allocate process table", errno); // Out of memory
+        free(pids);
+        return -1;
+    }
+    table->capacity = npids;
+    if (fields == SNAPSHOT_EXTENDED) {
+        table->ext = calloc((size_t)npids + 1, sizeof(ProcessExt)); // Parsed alongside procs
+        if (!table->ext) {
+            print_error("Cannot allocate extended fields", errno); // Out of memory
+            free(pids);
+            snapshot_free(table);
+            return -1;
         }
+        table->ext_complete = 1;
     }
-    closedir(dir); // Release directory handle
-}
 
-// List all grandchildren of the target process
-void list_grandchildren(pid_t pid) {
-    DIR *dir = opendir("/proc"); // Start scanning processes
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Report dir failure
-        return;
+    // Split the PID list into one chunk per worker; tiny tables are not worth a thread
+    int jobs = run_options.jobs;
+    if (jobs > npids / 256) jobs = npids / 256;
+    if (jobs < 1) jobs = 1;
+    ParseChunk chunks[1024];     // --jobs is capped at 1024
+    pthread_t threads[1024];     // Worker handles, parallel to chunks
+    int started[1024] = {0};     // Whether chunks[i] runs on its own thread
+    int per_chunk = (npids + jobs - 1) / jobs;
+    for (int j = 0; j < jobs; j++) {
+        int begin = j * per_chunk;                          // Each chunk writes procs[begin .. begin + n)
+        int n = (begin + per_chunk <= npids) ? per_chunk : npids - begin;
+        if (n < 0) n = 0;
+        chunks[j] = (ParseChunk){pids + begin, n, table->procs + begin, 0, table->ext ? table->ext + begin : NULL};
+        if (j > 0) {                                        // Chunk 0 runs on the calling thread
+            started[j] = pthread_create(&threads[j], NULL, parse_chunk, &chunks[j]) == 0;
+        }
     }
-    struct dirent *entry; // Outer loop for children
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Skip non-PIDs
-        pid_t child_pid = atoi(entry->d_name); // Get child PID
-        ProcessInfo child_info = get_process_info(child_pid); // Child process info
-        if (child_info.ppid != pid) continue;                // Not a direct child
-
-        DIR *dir2 = opendir("/proc"); // Inner loop for grandchildren
-        if (!dir2) {
-            print_error("Cannot access /proc directory for grandchildren", errno); // Inner dir error
-            closedir(dir);                                                 // Clean up outer dir
-            return;
+    parse_chunk(&chunks[0]);                                // Do our own share meanwhile
+    for (int j = 1; j < jobs; j++) {
+        if (started[j]) pthread_join(threads[j], NULL);     // Wait for the worker
+        else parse_chunk(&chunks[j]);                       // Thread creation failed; parse inline
+    }
+    free(pids); // PID list no longer needed
+
+    // Merge: slide each chunk's records down so the table is dense; no locking needed
+    for (int j = 0; j < jobs; j++) {
+        memmove(table->procs + table->count, chunks[j].out, (size_t)chunks[j].parsed * sizeof(ProcessInfo));
+        if (table->ext) memmove(table->ext + table->count, chunks[j].ext, (size_t)chunks[j].parsed * sizeof(ProcessExt));
+        table->count += chunks[j].parsed;
+    }
+    for (int i = 0; i < table->count; i++) {
+        if (table->procs[i].pid > table->max_pid) table->max_pid = table->procs[i].pid; // Track lookup bound
+    }
+    if (run_options.ns_inode) { // Only members were listed; record what each one is called inside
+        table->ns_pid = malloc(((size_t)table->count + 1) * sizeof(pid_t));
+        if (!table->ns_pid) {
+            print_error("Cannot allocate namespace PIDs", errno); // Out of memory
+            snapshot_free(table);
+            return -1;
         }
+        for (int i = 0; i < table->count; i++) table->ns_pid[i] = read_ns_pid(table->procs[i].pid);
+    }
+    phase_ms[PHASE_PARSE] += monotonic_ms() - phase_start;
 
-        struct dirent *entry2; // Iterate grandchildren
-        while ((entry2 = readdir(dir2)) != NULL) {
-            if (!isdigit(*entry2->d_name)) continue; // Filter out non-PIDs
-            pid_t grand_pid = atoi(entry2->d_name); // Parse grandchild PID
-            if (get_process_info(grand_pid).ppid == child_pid) { // Check if child’s child
-                printf("%d\n", grand_pid);                       // Print grandchild
-            }
+    phase_start = monotonic_ms();
+    int status = snapshot_index(table); // Build lookups over the merged records
+    phase_ms[PHASE_INDEX] += monotonic_ms() - phase_start;
+    return status;
+}
+
+// Append one record, plus its extended fields for tables that carry them; -1 when memory runs out
+static int table_append(ProcessTable *table, ProcessInfo info, const ProcessExt *ext) {
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 16; // Chains and small subtrees; grow rarely
+        ProcessInfo *grown = realloc(table->procs, ((size_t)capacity + 1) * sizeof(ProcessInfo));
+        if (grown) table->procs = grown;
+        ProcessExt *grown_ext = grown && ext ? realloc(table->ext, ((size_t)capacity + 1) * sizeof(ProcessExt)) : NULL;
+        if (grown_ext) table->ext = grown_ext;
+        if (!grown || (ext && !grown_ext)) {
+            print_error("Cannot allocate process table", errno); // Out of memory
+            return -1;
         }
-        closedir(dir2); // Close inner directory
+        table->capacity = capacity;
     }
-    closedir(dir); // Close outer directory
+    if (ext) table->ext[table->count] = *ext;
+    table->procs[table->count++] = info;
+    if (info.pid > table->max_pid) table->max_pid = info.pid; // Track lookup bound
+    return 0;
 }
 
-// Display whether the process is defunct or active
-void print_status(pid_t pid) {
-    ProcessInfo info = get_process_info(pid); // Get process state
-    if (info.pid == 0) {
-        fprintf(stderr, "Error: Cannot get status for process %d\n", pid); // Status fetch failed
-        return;
+// Append pid and its ancestors, stopping at root_pid, at a top or when a PID repeats. The root is
+// read on its own if the chain misses it, and then 1 is returned: pid is outside the root's tree.
+// Extended fields come along when fields asks for them; *threads, when not NULL, gets pid's thread count.
+static int chain_collect(ProcessTable *table, pid_t root_pid, pid_t pid, int fields, int *threads) {
+    int found_root = 0;
+    for (pid_t next = pid; next > 0 && !found_root; ) {
+        int repeated = 0; // A PID seen before closes a cycle; chains are short enough to search
+        for (int i = 0; i < table->count && !repeated; i++) repeated = table->procs[i].pid == next;
+        if (repeated) break;
+        ProcessExt ext = {0};
+        int count;
+        ProcessInfo info = walk_record(next, fields, &ext, &count);
+        if (info.pid == 0) break; // Gone or unreadable: the chain ends here, as in a full scan
+        if (threads && next == pid) *threads = count;
+        if (table_append(table, info, fields == SNAPSHOT_EXTENDED ? &ext : NULL) == -1) return -1;
+        found_root = next == root_pid;
+        next = info.ppid; // Climb one level
+    }
+    if (!found_root) {
+        ProcessExt ext = {0};
+        ProcessInfo root = get_process_record(root_pid, fields == SNAPSHOT_EXTENDED ? &ext : NULL); // Existence check
+        if (root.pid != 0 && table_append(table, root, fields == SNAPSHOT_EXTENDED ? &ext : NULL) == -1) return -1;
+        return 1;
     }
-    printf("Process %d is %s\n", pid, (info.state == 'Z') ? "Defunct" : "Not Defunct"); // Report status
+    return 0;
 }
 
-// Terminate parents of zombie descendants
-void kill_zombie_parents(pid_t pid) {
-    DIR *dir = opendir("/proc"); // Open /proc for process scan
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Dir access error
-        return;
+// Read only pid and its ancestors up to root_pid. Membership and point answers come out the same
+// as from a full scan, for a handful of stat reads and no /proc listing.
+int snapshot_build_chain(ProcessTable *table, pid_t root_pid, pid_t pid) {
+    memset(table, 0, sizeof(*table)); // Start from an empty table
+    double phase_start = monotonic_ms();
+    if (chain_collect(table, root_pid, pid, SNAPSHOT_BASIC, NULL) == -1) {
+        snapshot_free(table);
+        return -1;
     }
+    phase_ms[PHASE_PARSE] += monotonic_ms() - phase_start;
 
-    struct dirent *entry; // Directory entry iterator
-    int killed_any = 0;   // Flag for any kills performed
+    phase_start = monotonic_ms();
+    int status = snapshot_index(table); // A chain is a path, so the usual labels answer is_in_tree()
+    phase_ms[PHASE_INDEX] += monotonic_ms() - phase_start;
+    return status;
+}
 
-    while ((entry = readdir(dir)) != NULL) { // Scan all processes
-        if (!isdigit(*entry->d_name)) continue; // Skip non-numeric
-        pid_t curr_pid = atoi(entry->d_name);  // Convert to PID
-        ProcessInfo info = get_process_info(curr_pid); // Get process details
-        if (info.pid == 0 || !is_in_tree(pid, curr_pid)) continue; // Skip if not in tree
+// Append the PIDs listed in one /proc/[pid]/task/[tid]/children file to out; -1 if it cannot be opened
+static int read_children_file(const char *path, PidArena *out) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    COUNT(syscalls, 1);
+    if (fd == -1) return -1;
 
-        if (info.state == 'Z' && info.ppid != 0) { // Found a zombie with a parent
-            pid_t parent_to_kill = info.ppid;     // Target its parent
-            if (kill(parent_to_kill, SIGKILL) == -1) { // Attempt kill
-                char msg[64];                         // Buffer for custom error
-                snprintf(msg, sizeof(msg), "Failed to kill parent %d of zombie %d", parent_to_kill, curr_pid);
-                print_error(msg, errno);              // Report kill failure
-            } else {
-                printf("Killed parent %d of zombie process %d\n", parent_to_kill, curr_pid); // Success message
-                killed_any = 1;                       // Mark that we killed something
+    char buf[4096]; // "123 456 789 " with no newline; may span several reads
+    pid_t value = 0;
+    int in_number = 0;
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        COUNT(syscalls, 1);
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] >= '0' && buf[i] <= '9') {
+                value = value * 10 + (buf[i] - '0');
+                in_number = 1;
+            } else if (in_number) {
+                pid_arena_push(out, value); // On allocation failure the child is just missed
+                value = 0;
+                in_number = 0;
             }
         }
     }
-    closedir(dir); // Clean up
+    if (in_number) pid_arena_push(out, value);
+    close(fd);
+    COUNT(syscalls, 2); // Final read and close
+    return 0;
+}
 
-    if (!killed_any) { // If no zombies were found to act on
-        printf("No zombie processes found among descendants of %d\n", pid); // Inform user
+// Replace out's contents with pid's children. A child is listed under the thread that forked it, so
+// multi-threaded parents need every task's file; -1 if pid is gone
+static int read_children(pid_t pid, int threads, PidArena *out) {
+    char path[64];
+    out->count = 0;
+    if (threads <= 1) {
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/children", pid, pid);
+        return read_children_file(path, out);
     }
-}
-// Terminate all descendants with SIGKILL, ensuring grandchildren are included
-void kill_descendants(pid_t pid) {
-    DIR *dir = opendir("/proc"); // Open /proc to scan processes
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Report if /proc unavailable
-        return;
+    snprintf(path, sizeof(path), "/proc/%d/task", pid);
+    DIR *dir = opendir(path);
+    COUNT(syscalls, 1);
+    if (!dir) return -1;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        COUNT(syscalls, 1); // Roughly one getdents per call on small task lists
+        pid_t tid = parse_pid_name(entry->d_name);
+        if (!tid) continue; // "." and ".."
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/children", pid, tid);
+        read_children_file(path, out);
     }
+    closedir(dir);
+    COUNT(syscalls, 1);
+    return 0;
+}
 
-    // Array to store descendants (arbitrary max size; adjust as needed)
-    pid_t descendants[1024]; // Buffer for PIDs
-    int descendant_count = 0; // Track number of descendants found
-    struct dirent *entry;     // Directory entry iterator
-
-    // First pass: Collect all descendants into an array
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Skip non-numeric entries
-        pid_t curr_pid = atoi(entry->d_name);  // Parse PID from dir name
-        ProcessInfo info = get_process_info(curr_pid); // Fetch process details
-        if (info.pid == 0) continue;                  // Skip if process doesn’t exist
-        if (is_in_tree(pid, curr_pid) && curr_pid != pid) { // In tree, not target
-            if (descendant_count < 1024) {                    // Check buffer limit
-                descendants[descendant_count++] = curr_pid;   // Add to list
-            } else {
-                fprintf(stderr, "Warning: Too many descendants; some may be missed\n"); // Warn on overflow
-                break;
-            }
-        }
+// Read pid's ancestor chain, then walk its subtree top-down through the kernel's children files,
+// levels deep (-1 for all), so only the subtree is touched. Returns 1 with an empty table when the
+// caller should take a full snapshot instead: no children files (CONFIG_PROC_CHILDREN), or a
+// subtree past CHILDREN_WALK_LIMIT, where one /proc listing is cheaper. Extended fields are parsed
+// only when fields asks for them; otherwise they load lazily, as after a basic full scan.
+int snapshot_build_subtree(ProcessTable *table, pid_t root_pid, pid_t pid, int levels, int fields) {
+    memset(table, 0, sizeof(*table)); // Start from an empty table
+    COUNT(syscalls, 1);
+    if (access("/proc/thread-self/children", R_OK) == -1) return 1; // Kernel without the files
+    double phase_start = monotonic_ms();
+
+    table->ext_complete = fields == SNAPSHOT_EXTENDED; // Every record below comes with its extended fields
+    int threads_size = 16;                             // Chains and small subtrees; grow rarely
+    int *threads = malloc((size_t)threads_size * sizeof(int)); // Per slot: thread count, for read_children()
+    if (!threads) {
+        print_error("Cannot allocate process table", errno); // Out of memory
+        return -1;
     }
-    closedir(dir); // Close initial scan
+    threads[0] = 0;
+    int status = chain_collect(table, root_pid, pid, fields, &threads[0]); // The target is slot 0
+    int outside = status == 1; // The answer is a notice; no need to read the subtree
+    if (outside) status = 0;
+    unsigned char *seen = NULL; // PID-indexed: already in the table
+    pid_t seen_size = 0;
+    for (int i = 0; i < table->count; i++) pid_map_mark(&seen, &seen_size, table->procs[i].pid);
 
-    // Second pass: Kill from deepest to shallowest by iterating backwards
-    for (int i = descendant_count - 1; i >= 0; i--) {
-        pid_t curr_pid = descendants[i]; // Get PID to kill
-        if (kill(curr_pid, SIGKILL) == -1) { // Send SIGKILL
-            char msg[64];                    // Buffer for error message
-            snprintf(msg, sizeof(msg), "Failed to kill descendant %d", curr_pid);
-            print_error(msg, errno);         // Report kill failure
-        } else {
-            printf("Killed descendant %d\n", curr_pid); // Confirm successful kill
-        }
-    }
-
-    // Optional: Re-scan to catch any missed descendants (e.g., new forks)
-    dir = opendir("/proc"); // Re-open /proc for verification
-    if (dir) {
-        int missed = 0; // Count of missed descendants
-        while ((entry = readdir(dir)) != NULL) {
-            if (!isdigit(*entry->d_name)) continue;
-            pid_t curr_pid = atoi(entry->d_name);
-            ProcessInfo info = get_process_info(curr_pid);
-            if (info.pid == 0) continue;
-            // Check if still alive and in tree
-            if (is_in_tree(pid, curr_pid) && curr_pid != pid) {
-                missed++;
-                if (kill(curr_pid, SIGKILL) == -1) {
-                    char msg[64];
-                    snprintf(msg, sizeof(msg), "Failed to kill missed descendant %d", curr_pid);
-                    print_error(msg, errno);
-                } else {
-                    printf("Killed missed descendant %d\n", curr_pid);
+    PidArena kids = {0}; // One parent's children at a time
+    int begin = 0, end = !outside && status == 0 && table->count && table->procs[0].pid == pid; // Level 0: the target, slot 0
+    for (int level = 0; level != levels && begin < end && status == 0; level++) {
+        int next_begin = table->count; // The next level is appended after everything read so far
+        for (int i = begin; i < end && status == 0; i++) {
+            pid_t parent = table->procs[i].pid;
+            if (table->procs[i].state == 'Z') continue; // An exited process keeps no children
+            if (read_children(parent, threads[i], &kids) == -1) continue; // Exited since
+            for (int k = 0; k < kids.count && status == 0; k++) {
+                if (!pid_map_mark(&seen, &seen_size, kids.pids[k])) continue; // Reparented mid-walk, already read
+                ProcessExt ext = {0};
+                int count;
+                ProcessInfo info = walk_record(kids.pids[k], fields, &ext, &count);
+                if (info.pid == 0 || info.ppid != parent) {       // Exited or moved since the list was read
+                    if (kids.pids[k] < seen_size) seen[kids.pids[k]] = 0; // Its new parent may still list it
+                    continue;
+                }
+                if (table->count >= threads_size) { // The ancestor chain may already be long
+                    int size = threads_size;
+                    while (size <= table->count) size *= 2;
+                    int *grown = realloc(threads, (size_t)size * sizeof(int));
+                    if (!grown) {
+                        print_error("Cannot allocate process table", errno); // Out of memory
+                        status = -1;
+                        break;
+                    }
+                    threads = grown;
+                    threads_size = size;
                 }
+                threads[table->count] = count;
+                status = table_append(table, info, fields == SNAPSHOT_EXTENDED ? &ext : NULL);
             }
+            if (table->count > CHILDREN_WALK_LIMIT) status = 1; // A full scan is cheaper from here on
         }
-        if (missed > 0) {
-            fprintf(stderr, "Note: %d descendants were missed in first pass and killed in second\n", missed); // Inform user
-        }
-        closedir(dir); // Clean up
+        begin = next_begin;
+        end = table->count;
+    }
+    free(seen);
+    free(threads);
+    pid_arena_free(&kids);
+    phase_ms[PHASE_PARSE] += monotonic_ms() - phase_start;
+    if (status != 0) {
+        snapshot_free(table);
+        return status;
     }
+
+    phase_start = monotonic_ms();
+    status = snapshot_index(table); // Labels and DFS columns exactly as for a full scan
+    phase_ms[PHASE_INDEX] += monotonic_ms() - phase_start;
+    return status;
 }
 
-// Pause all descendants with SIGSTOP
-void stop_descendants(pid_t pid) {
-    DIR *dir = opendir("/proc"); // Open /proc directory
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Access error
-        return;
+// Gather the snapshot query needs: the ancestor chain for point queries, the subtree for children
+// and subtree queries (only as many levels as the option looks at), a full scan otherwise
+int snapshot_build_for(ProcessTable *table, const Query *query) {
+    int plan = run_options.ns_inode ? PLAN_TABLE : query_plan(query); // --ns: the namespace's members are the table
+    if (plan <= PLAN_ANCESTORS) return snapshot_build_chain(table, query->root_pid, query->target_pid);
+    if (plan <= PLAN_SUBTREE) {
+        int levels = plan == PLAN_CHILDREN ? 1 : -1;        // -1: the whole subtree
+        if (strcmp(query->option, "-gc") == 0 || strcmp(query->option, "-sg") == 0) levels = 2; // Grandchildren
+        if (strcmp(query->option, "-depth") == 0) levels = query->value;
+        int status = snapshot_build_subtree(table, query->root_pid, query->target_pid, levels, query_fields(query));
+        if (status != 1) return status;                     // Built, or failed and reported
     }
+    return snapshot_build(table, query_fields(query));
+}
 
-    struct dirent *entry; // Process iterator
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Skip non-numeric
-        pid_t curr_pid = atoi(entry->d_name);  // Extract PID
-        ProcessInfo info = get_process_info(curr_pid); // Fetch data
-        if (info.pid == 0) continue;                  // Skip missing
-        if (is_in_tree(pid, curr_pid) && curr_pid != pid) { // Check descendant
-            if (kill(curr_pid, SIGSTOP) == -1) {            // Attempt stop
-                print_error("Failed to stop descendant process", errno); // Stop failed
-            } else {
-                printf("Stopped descendant %d\n", curr_pid); // Confirm stop
-            }
-        }
+// Get the table a run answers from: the --from-snapshot file, a full scan that is also written to
+// --save-snapshot, or whatever query_plan() needs (a full basic scan when query is NULL, as in batch mode)
+int snapshot_acquire(ProcessTable *table, const Query *query) {
+    if (run_options.from_snapshot) return snapshot_load(table, run_options.from_snapshot);
+    if (!run_options.save_snapshot) return query ? snapshot_build_for(table, query) : snapshot_build(table, SNAPSHOT_BASIC);
+
+    if (snapshot_build(table, SNAPSHOT_EXTENDED) == -1) return -1; // Saved files carry -sum/-agg fields too
+    for (int i = 0; i < table->count; i++) table->ext[i].loaded = 1; // Replays must never read this host's /proc
+    if (snapshot_save(table, run_options.save_snapshot) == -1) {
+        snapshot_free(table);
+        return -1;
     }
-    closedir(dir); // Clean up
+    return 0;
 }
 
-// Resume stopped descendants with SIGCONT
-void continue_descendants(pid_t pid) {
-    DIR *dir = opendir("/proc"); // Open process directory
-    if (!dir) {
-        print_error("Cannot access /proc directory", errno); // Dir error
-        return;
+// Byte length of each section for a table of count records and PIDs up to max_pid
+static void snapshot_section_sizes(int count, pid_t max_pid, uint64_t size[SNAP_SECTION_COUNT]) {
+    uint64_t n = (uint64_t)count;
+    size[SNAP_PROCS] = n * sizeof(ProcessInfo);
+    size[SNAP_SLOT_OF] = ((uint64_t)max_pid + 1) * sizeof(int);
+    size[SNAP_CHILD_START] = (n + 1) * sizeof(int);
+    size[SNAP_CHILD_SLOTS] = n * sizeof(int);
+    size[SNAP_DEPTH] = size[SNAP_TIN] = size[SNAP_TOUT] = n * sizeof(int);
+    size[SNAP_DFS_PID] = size[SNAP_DFS_PPID] = n * sizeof(pid_t);
+    size[SNAP_DFS_STATE] = n;
+    size[SNAP_DFS_SLOT] = n * sizeof(int);
+    size[SNAP_EXT] = n * sizeof(ProcessExt);
+}
+
+// Write all of buf at offset, retrying short writes
+static int write_all(int fd, const void *buf, size_t len, off_t offset) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        offset += n;
     }
+    return 0;
+}
 
-    struct dirent *entry; // Iterator for /proc entries
-    while ((entry = readdir(dir)) != NULL) {
-        if (!isdigit(*entry->d_name)) continue; // Ignore non-PIDs
-        pid_t curr_pid = atoi(entry->d_name);  // Parse PID
-        ProcessInfo info = get_process_info(curr_pid); // Get process info
-        if (info.pid == 0) continue;                  // Skip if gone
-        // Check if descendant, not self, and stopped
-        if (is_in_tree(pid, curr_pid) && curr_pid != pid && info.state == 'T') {
-            if (kill(curr_pid, SIGCONT) == -1) {      // Try to continue
-                print_error("Failed to continue descendant process", errno); // Report failure
-            } else {
-                printf("Continued descendant %d\n", curr_pid); // Confirm continue
-            }
-        }
+// Write table to path: a fixed header, then every array the queries use, each 64-byte aligned.
+// The file is written beside path and renamed over it, so readers never see a partial snapshot.
+int snapshot_save(const ProcessTable *table, const char *path) {
+    SnapshotFileHeader header = {0};
+    memcpy(header.magic, SNAPSHOT_FILE_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_FILE_VERSION;
+    header.header_size = sizeof(header);
+    header.info_size = sizeof(ProcessInfo);
+    header.ext_size = sizeof(ProcessExt);
+    header.captured = (int64_t)time(NULL);
+    header.count = table->count;
+    header.max_pid = table->max_pid;
+    snapshot_section_sizes(table->count, table->max_pid, header.size);
+    uint64_t offset = sizeof(header);
+    for (int i = 0; i < SNAP_SECTION_COUNT; i++) {
+        offset = (offset + SNAPSHOT_FILE_ALIGN - 1) / SNAPSHOT_FILE_ALIGN * SNAPSHOT_FILE_ALIGN;
+        header.offset[i] = offset;
+        offset += header.size[i];
+    }
+    const void *data[SNAP_SECTION_COUNT] = {
+        table->procs, table->slot_of, table->child_start, table->child_slots, table->depth, table->tin, table->tout,
+        table->dfs_pid, table->dfs_ppid, table->dfs_state, table->dfs_slot, table->ext
+    };
+
+    char tmp[4096]; // Sibling of path, same filesystem for rename()
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        fprintf(stderr, "Error: Snapshot path '%s' is too long\n", path);
+        return -1;
+    }
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        print_error("Cannot create snapshot file", errno);
+        return -1;
+    }
+    int status = write_all(fd, &header, sizeof(header), 0);
+    for (int i = 0; i < SNAP_SECTION_COUNT && status == 0; i++) {
+        if (header.size[i]) status = write_all(fd, data[i], header.size[i], (off_t)header.offset[i]);
+    }
+    if (status == 0 && ftruncate(fd, (off_t)offset) == -1) status = -1; // Padding after the last section
+    if (close(fd) == -1) status = -1;
+    if (status == 0 && rename(tmp, path) == -1) status = -1;
+    if (status == -1) {
+        print_error("Cannot write snapshot file", errno);
+        unlink(tmp);
+    }
+    return status;
+}
+
+// Check a mapped table's index arrays before any query trusts them: every slot, row and offset in
+// range, each child listed exactly once under its own parent, DFS rows and slots mutual inverses.
+// Traversals then terminate exactly as on a scanned table. 1 if consistent, 0 if not, -1 on no memory
+static int snapshot_check_index(ProcessTable *table) {
+    int n = table->count;
+    for (pid_t pid = 0; pid <= table->max_pid; pid++) { // PID lookup points at the record it names
+        int slot = table->slot_of[pid];
+        if (slot < 0 || slot > n || (slot && table->procs[slot - 1].pid != pid)) return 0;
+    }
+    int children = 0; // Records that hang under a parent, as the children index must hold
+    for (int i = 0; i < n; i++) {
+        pid_t pid = table->procs[i].pid;
+        if (pid <= 0 || pid > table->max_pid || table->slot_of[pid] != i + 1) return 0;
+        if (table->child_start[i + 1] < table->child_start[i]) return 0;
+        if (table->tin[i] < 0 || table->tin[i] >= table->tout[i] || table->tout[i] > n) return 0;
+        if (table->dfs_slot[i] < 0 || table->dfs_slot[i] >= n || table->depth[i] < DEPTH_CYCLE) return 0;
+        children += snapshot_parent(table, i) >= 0;
+        table->ext[i].comm[sizeof(table->ext[i].comm) - 1] = '\0'; // Printed with %s
+    }
+    if (table->child_start[0] != 0 || table->child_start[n] != children) return 0;
+    for (int row = 0; row < n; row++) { // Row r holds slot s exactly when s was entered at time r
+        int slot = table->dfs_slot[row];
+        if (table->tin[slot] != row || table->dfs_pid[row] != table->procs[slot].pid) return 0;
     }
-    closedir(dir); // Close directory
-}
\ No newline at end of file
+
+    unsigned char *listed = calloc((size_t)n + 1, 1); // Per slot: already seen in the children index
+    if (!listed) {
+        print_error("Cannot allocate snapshot check", errno); // Out of memory
+        return -1;
+    }
+    int valid = 1;
+    for (int parent = 0; parent < n && valid; parent++) {
+        for (int c = table->child_start[parent]; c < table->child_start[parent + 1] && valid; c++) {
+            int child = table->child_slots[c];
+            valid = child >= 0 && child < n && !listed[child] && snapshot_parent(table, child) == parent;
+            if (valid) listed[child] = 1;
+        }
+    }
+    free(listed);
+    return valid;
+}
+
+// Map a file written by snapshot_save() and point table's arrays into it; nothing is copied and
+// /proc is never read. The mapping is private, so the table stays writable like a scanned one.
+
+int snapshot_load(ProcessTable *table, const char *path) {
+    memset(table, 0, sizeof(*table)); // Start from an empty table
+    double phase_start = monotonic_ms();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        print_error("Cannot open snapshot file", errno);
+        return -1;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SnapshotFileHeader)) {
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    COUNT(syscalls, 4); // open, fstat, mmap, close: the whole cost of a load
+
+    // Reject anything that is not this version's layout, or whose sections fall outside the file
+    const SnapshotFileHeader *header = map;
+    int valid = map != MAP_FAILED && memcmp(header->magic, SNAPSHOT_FILE_MAGIC, sizeof(header->magic)) == 0 &&
+                header->version == SNAPSHOT_FILE_VERSION && header->header_size == sizeof(SnapshotFileHeader) &&
+                header->info_size == sizeof(ProcessInfo) && header->ext_size == sizeof(ProcessExt) &&
+                header->count >= 0 && header->max_pid >= 0;
+    uint64_t size[SNAP_SECTION_COUNT];
+    if (valid) snapshot_section_sizes(header->count, header->max_pid, size);
+    for (int i = 0; i < SNAP_SECTION_COUNT && valid; i++) {
+        valid = header->size[i] == size[i] && header->offset[i] % SNAPSHOT_FILE_ALIGN == 0 &&
+                header->offset[i] <= (uint64_t)st.st_size && size[i] <= (uint64_t)st.st_size - header->offset[i];
+    }
+    if (!valid) {
+        fprintf(stderr, "Error: %s is not a version %d process snapshot\n", path, SNAPSHOT_FILE_VERSION);
+        if (map != MAP_FAILED) munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    char *base = map;
+    table->procs = (ProcessInfo *)(base + header->offset[SNAP_PROCS]);
+    table->slot_of = (int *)(base + header->offset[SNAP_SLOT_OF]);
+    table->child_start = (int *)(base + header->offset[SNAP_CHILD_START]);
+    table->child_slots = (int *)(base + header->offset[SNAP_CHILD_SLOTS]);
+    table->depth = (int *)(base + header->offset[SNAP_DEPTH]);
+    table->tin = (int *)(base + header->offset[SNAP_TIN]);
+    table->tout = (int *)(base + header->offset[SNAP_TOUT]);
+    table->dfs_pid = (pid_t *)(base + header->offset[SNAP_DFS_PID]);
+    table->dfs_ppid = (pid_t *)(base + header->offset[SNAP_DFS_PPID]);
+    table->dfs_state = base + header->offset[SNAP_DFS_STATE];
+    table->dfs_slot = (int *)(base + header->offset[SNAP_DFS_SLOT]);
+    table->ext = (ProcessExt *)(base + header->offset[SNAP_EXT]);
+    table->count = table->capacity = header->count;
+    table->max_pid = header->max_pid;
+    table->ext_complete = 1; // Saved with every extended field loaded
+    table->map = map;
+    table->map_size = (size_t)st.st_size;
+    int consistent = snapshot_check_index(table);
+    if (consistent != 1) {
+        if (consistent == 0) fprintf(stderr, "Error: %s has an inconsistent process index\n", path); // Corrupt or hand-edited
+        snapshot_free(table);
+        return -1;
+    }
+    phase_ms[PHASE_PARSE] += monotonic_ms() - phase_start;
+    return 0;
+}
+
+// Build the PID lookup and children index for the records already in table->procs
+int snapshot_index(ProcessTable *table) {
+    // Build the PID-indexed lookup so queries never touch /proc again
+    table->slot_of = calloc((size_t)table->max_pid + 1, sizeof(int));
+    if (!table->slot_of) {
+        print_error("Cannot allocate process index", errno); // Out of memory
+        snapshot_free(table);
+        return -1;
+    }
+    for (int i = 0; i < table->count; i++) {
+        table->slot_of[table->procs[i].pid] = i + 1; // Store slot + 1 so 0 means absent
+    }
+    return snapshot_index_children(table); // Derive the children index from the lookup
+}
+
+// Build the parent -> children index in compressed sparse row form; any previous index is replaced
+int snapshot_index_children(ProcessTable *table) {
+    free(table->child_start); // Drop a stale index, if any
+    free(table->child_slots);
+    table->child_start = calloc((size_t)table->count + 1, sizeof(int));
+    table->child_slots = malloc(((size_t)table->count + 1) * sizeof(int));
+    if (!table->child_start || !table->child_slots) {
+        print_error("Cannot allocate children index", errno); // Out of memory
+        snapshot_free(table);
+        return -1;
+    }
+    for (int i = 0; i < table->count; i++) { // Count children per parent slot
+        int parent = snapshot_parent(table, i);
+        if (parent >= 0) table->child_start[parent + 1]++;
+    }
+    for (int i = 0; i < table->count; i++) { // Prefix sums turn counts into offsets
+        table->child_start[i + 1] += table->child_start[i];
+    }
+    int *fill = malloc(((size_t)table->count + 1) * sizeof(int)); // Next free position per parent
+    if (!fill) {
+        print_error("Cannot allocate children index", errno); // Out of memory
+        snapshot_free(table);
+        return -1;
+    }
+    memcpy(fill, table->child_start, (size_t)table->count * sizeof(int));
+    for (int i = 0; i < table->count; i++) { // Scatter each child under its parent
+        int parent = snapshot_parent(table, i);
+        if (parent >= 0) table->child_slots[fill[parent]++] = i;
+    }
+    free(fill); // Offsets no longer needed
+    return snapshot_index_order(table); // Depths and DFS labels follow the parent links
+}
+
+// Copy slot's record into DFS row
+static void dfs_place(ProcessTable *table, int slot, int row) {
+    table->dfs_pid[row] = table->procs[slot].pid;
+    table->dfs_ppid[row] = table->procs[slot].ppid;
+    table->dfs_state[row] = table->procs[slot].state;
+    table->dfs_slot[row] = slot;
+}
+
+// Label every slot by an iterative DFS down from the tops of the forest (processes whose parent is not
+// in the table): its depth, and entry/exit times tin/tout with records copied to the dfs_* columns in
+// visit order, so the subtree of slot s is exactly rows [tin[s] .. tout[s]). Slots no top reaches sit on (or below)
+// a parent cycle, which PID reuse during the scan can create; a second pass enters each such cycle at
+// one of its members and labels it with DEPTH_CYCLE.
+int snapshot_index_order(ProcessTable *table) {
+    free(table->depth); // Drop stale labels, if any
+    free(table->tin);
+    free(table->tout);
+    free(table->dfs_pid);
+    free(table->dfs_ppid);
+    free(table->dfs_state);
+    free(table->dfs_slot);
+    size_t n = (size_t)table->count + 1;
+    if (!table->ext_complete) {    // Slots moved; lazily loaded fields start over
+        free(table->ext);
+        table->ext = calloc(n, sizeof(ProcessExt));
+    }
+    table->depth = malloc(n * sizeof(int));
+    table->tin = malloc(n * sizeof(int));
+    table->tout = malloc(n * sizeof(int));
+    table->dfs_pid = malloc(n * sizeof(pid_t));
+    table->dfs_ppid = malloc(n * sizeof(pid_t));
+    table->dfs_state = malloc(n);
+    table->dfs_slot = malloc(n * sizeof(int));
+    int *stack = malloc(n * sizeof(int));  // Current DFS path, one slot per level
+    int *cursor = malloc(n * sizeof(int)); // Next child offset per level
+    if (!table->depth || !table->tin || !table->tout || !table->dfs_pid || !table->dfs_ppid || !table->dfs_state || !table->dfs_slot || !table->ext || !stack || !cursor) {
+        print_error("Cannot allocate ancestry index", errno); // Out of memory
+        free(stack);
+        free(cursor);
+        snapshot_free(table);
+        return -1;
+    }
+    for (int i = 0; i < table->count; i++) table->tin[i] = table->tout[i] = -1; // Nothing visited
+
+    int time = 0; // Next DFS row
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < table->count; i++) {
+            if (table->tin[i] != -1) continue; // Already labelled
+            int start = i;
+            if (pass == 0) {
+                if (snapshot_parent(table, i) >= 0) continue; // Not a top; reached from one, or cyclic
+            } else {
+                // Climb until a slot repeats; that slot is on the cycle i hangs from
+                while (table->tout[start] != -2 - i) {
+                    table->tout[start] = -2 - i; // Stamp unique to this climb
+                    start = snapshot_parent(table, start);
+                }
+            }
+
+            int top = 0; // Depth-first walk from start, without recursion
+            stack[0] = start;
+            cursor[0] = table->child_start[start];
+            table->depth[start] = pass ? DEPTH_CYCLE : 0;
+            table->tin[start] = time;
+            dfs_place(table, start, time++);
+            while (top >= 0) {
+                int slot = stack[top];
+                if (cursor[top] == table->child_start[slot + 1]) { // Every child done
+                    table->tout[slot] = time;
+                    top--;
+                    continue;
+                }
+                int child = table->child_slots[cursor[top]++];
+                if (table->tin[child] != -1) continue; // A cycle's link back to its entry
+                table->depth[child] = pass ? DEPTH_CYCLE : table->depth[slot] + 1;
+                table->tin[child] = time;
+                dfs_place(table, child, time++);
+                stack[++top] = child;
+                cursor[top] = table->child_start[child];
+            }
+        }
+    }
+    free(stack);
+    free(cursor);
+    return 0;
+}
+
+// Release memory owned by a snapshot
+void snapshot_free(ProcessTable *table) {
+    if (table->map) {                     // Arrays live in the file mapping
+        munmap(table->map, table->map_size);
+        memset(table, 0, sizeof(*table));
+        return;
+    }
+    free(table->procs);               // Drop records
+    free(table->slot_of);             // Drop PID index
+    free(table->child_start);         // Drop children offsets
+    free(table->child_slots);         // Drop children payload
+    free(table->depth);               // Drop depths
+    free(table->tin);                 // Drop DFS labels
+    free(table->tout);
+    free(table->dfs_pid);             // Drop DFS-ordered columns
+    free(table->dfs_ppid);
+    free(table->dfs_state);
+    free(table->dfs_slot);
+    free(table->ext);                 // Drop extended fields
+    free(table->ns_pid);              // Drop namespace PIDs
+    memset(table, 0, sizeof(*table)); // Leave table safely empty
+}
+
+// Look up a PID in the snapshot; NULL when it was not present during the scan
+const ProcessInfo *snapshot_find(const ProcessTable *table, pid_t pid) {
+    if (pid <= 0 || pid > table->max_pid) return NULL; // Outside indexed range
+    int slot = table->slot_of[pid];                     // Fetch stored slot + 1
+    return slot ? &table->procs[slot - 1] : NULL;       // Translate to record
+}
+
+// Translate a PID to its slot in the snapshot; -1 when it was not present
+int snapshot_slot(const ProcessTable *table, pid_t pid) {
+    if (pid <= 0 || pid > table->max_pid) return -1; // Outside indexed range
+    return table->slot_of[pid] - 1;                   // Stored as slot + 1
+}
+
+// Slot of slot's parent; -1 for a top (parent absent or itself) and for a stale link. A parent that
+// started after its child cannot be the one that forked it: the real parent exited and its PID was
+// reused during the scan, so the child is treated as a top rather than misattributed.
+int snapshot_parent(const ProcessTable *table, int slot) {
+    const ProcessInfo *child = &table->procs[slot];
+    int parent = snapshot_slot(table, child->ppid);
+    if (parent < 0 || parent == slot) return -1;
+    unsigned long long born = table->procs[parent].starttime;
+    if (born && child->starttime && born > child->starttime) return -1; // 0 means unknown, as in daemon fork events
+    return parent;
+}
+
+// Collect pid's subtree in breadth-first order (pid itself first) into a malloc'd slot array
+int snapshot_subtree(const ProcessTable *table, pid_t pid, int **slots) {
+    *slots = NULL;                         // Nothing allocated yet
+    int start = snapshot_slot(table, pid); // Locate the subtree root
+    if (start < 0) return 0;               // Unknown PID has an empty subtree
+
+    int *queue = malloc((size_t)table->count * sizeof(int)); // Every slot appears at most once
+    if (!queue) {
+        print_error("Cannot allocate subtree queue", errno); // Out of memory
+        return -1;
+    }
+
+    int head = 0, tail = 0;  // BFS queue cursors; the queue doubles as the result
+    queue[tail++] = start;   // Seed with the root
+    while (head < tail) {
+        int slot = queue[head++]; // Next node to expand
+        for (int c = table->child_start[slot]; c < table->child_start[slot + 1]; c++) {
+            int child = table->child_slots[c];
+            if (child == start) continue; // A parent cycle can only pass through the root; never revisit it
+            queue[tail++] = child;        // Append child for expansion
+        }
+    }
+    *slots = queue; // Hand ownership to the caller
+    return tail;    // Number of slots in the subtree
+}
+
+// Return the first DFS row of pid's subtree (pid's own row) and the subtree's row count in *n
+int snapshot_range(const ProcessTable *table, pid_t pid, int *n) {
+    int slot = snapshot_slot(table, pid); // Locate the subtree root
+    if (slot < 0) {
+        *n = 0;                           // Unknown PID has an empty subtree
+        return 0;
+    }
+    *n = table->tout[slot] - table->tin[slot];
+    return table->tin[slot];
+}
+
+// Extended fields of slot: parsed by the scan for SNAPSHOT_EXTENDED tables, otherwise read on first use
+const ProcessExt *snapshot_ext(const ProcessTable *table, int slot) {
+    ProcessExt *ext = &table->ext[slot];
+    if (!ext->loaded) {
+        const ProcessInfo *seen = &table->procs[slot];
+        ProcessInfo now = get_process_record(seen->pid, ext);
+        if (now.pid != seen->pid || now.ppid != seen->ppid || (seen->starttime && now.starttime != seen->starttime)) {
+            memset(ext, 0, sizeof(*ext)); // Exited or recycled since the scan: contributes nothing
+        }
+        ext->loaded = 1;
+    }
+    return ext;
+}
+
+// Forget lazily loaded fields so the next use re-reads them (the daemon's records outlive one query)
+void snapshot_reset_ext(ProcessTable *table) {
+    if (table->ext && !table->ext_complete) memset(table->ext, 0, (size_t)table->count * sizeof(ProcessExt));
+}
+
+// Column kernels: whole-column filters over the dfs_* arrays. With SSE2 they compare 16 states or
+// 4 parent PIDs per instruction and turn the match mask into positions; the scalar loop handles
+// the tail, or everything on targets without SSE2.
+
+// Store the rows of state[0 .. n) equal to want in out, in order; returns how many
+int column_select_state(const char *state, int n, char want, int *out) {
+    int found = 0, i = 0;
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi8(want);
+    for (; i + 16 <= n; i += 16) {
+        __m128i rows = _mm_loadu_si128((const __m128i *)(state + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(rows, needle));
+        for (; mask; mask &= mask - 1) out[found++] = i + __builtin_ctz(mask); // One position per set bit
+    }
+#endif
+    for (; i < n; i++) {
+        if (state[i] == want) out[found++] = i;
+    }
+    return found;
+}
+
+// Store the rows of ppid[0 .. n) equal to want (equal != 0) or different from it (equal == 0); returns how many
+int column_select_ppid(const pid_t *ppid, int n, pid_t want, int equal, int *out) {
+    int found = 0, i = 0;
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi32(want);
+    unsigned flip = equal ? 0 : 0xF; // Invert the 4-lane mask for "not equal"
+    for (; i + 4 <= n; i += 4) {
+        __m128i rows = _mm_loadu_si128((const __m128i *)(ppid + i));
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(rows, needle))) ^ flip;
+        for (; mask; mask &= mask - 1) out[found++] = i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; i++) {
+        if ((ppid[i] == want) == (equal != 0)) out[found++] = i;
+    }
+    return found;
+}
+
+// Total every node of pid's subtree in one post-order pass. DFS rows put each child after its parent,
+// so walking the run backwards finishes a node before it is folded into its parent.
+int rollup_build(const ProcessTable *table, pid_t pid, int fields, Rollup *rollup) {
+    memset(rollup, 0, sizeof(*rollup));
+    rollup->first = snapshot_range(table, pid, &rollup->n);
+    size_t n = (size_t)rollup->n + 1;
+    int extended = fields == SNAPSHOT_EXTENDED;
+    rollup->procs = calloc(n, sizeof(long));
+    rollup->zombies = calloc(n, sizeof(long));
+    if (extended) {
+        rollup->threads = calloc(n, sizeof(long));
+        rollup->rss = calloc(n, sizeof(long));
+        rollup->utime = calloc(n, sizeof(unsigned long long));
+        rollup->stime = calloc(n, sizeof(unsigned long long));
+    }
+    if (!rollup->procs || !rollup->zombies ||
+        (extended && (!rollup->threads || !rollup->rss || !rollup->utime || !rollup->stime))) {
+        print_error("Cannot allocate subtree totals", errno); // Out of memory
+        rollup_free(rollup);
+        return -1;
+    }
+
+    for (int i = rollup->n - 1; i >= 0; i--) {
+        int row = rollup->first + i;
+        rollup->procs[i] += 1; // The node itself, on top of its children folded in earlier
+        rollup->zombies[i] += table->dfs_state[row] == 'Z';
+        if (extended) {
+            const ProcessExt *ext = snapshot_ext(table, table->dfs_slot[row]);
+            rollup->threads[i] += ext->num_threads;
+            rollup->rss[i] += ext->rss;
+            rollup->utime[i] += ext->utime;
+            rollup->stime[i] += ext->stime;
+        }
+
+        int parent = snapshot_slot(table, table->dfs_ppid[row]);
+        int up = parent < 0 ? -1 : table->tin[parent] - rollup->first; // Parent's index in this rollup
+        if (up < 0 || up >= i) continue; // Subtree root, or a cycle's link back to its entry
+        rollup->procs[up] += rollup->procs[i];
+        rollup->zombies[up] += rollup->zombies[i];
+        if (extended) {
+            rollup->threads[up] += rollup->threads[i];
+            rollup->rss[up] += rollup->rss[i];
+            rollup->utime[up] += rollup->utime[i];
+            rollup->stime[up] += rollup->stime[i];
+        }
+    }
+    return 0;
+}
+
+// Release the rollup's columns
+void rollup_free(Rollup *rollup) {
+    free(rollup->procs);
+    free(rollup->zombies);
+    free(rollup->threads);
+    free(rollup->rss);
+    free(rollup->utime);
+    free(rollup->stime);
+    memset(rollup, 0, sizeof(*rollup));
+}
+
+// Room for one position per row of an n-row selection
+static int *select_buffer(int n) {
+    int *rows = malloc(((size_t)n + 1) * sizeof(int));
+    if (!rows) print_error("Cannot allocate selection buffer", errno); // Out of memory
+    return rows;
+}
+
+// Append pid's descendants (pid excluded) to out, deepest level first; returns the number added or -1
+int collect_descendants_deepest_first(const ProcessTable *table, pid_t pid, PidArena *out) {
+    int *slots;                                   // BFS order: levels never decrease
+    int n = snapshot_subtree(table, pid, &slots);
+    if (n < 0) return -1;                         // snapshot_subtree already reported it
+    if (n > 1 && pid_arena_reserve(out, out->count + n - 1) == -1) {
+        free(slots);
+        return -1;                                // Sized exactly from the snapshot
+    }
+    for (int i = n - 1; i >= 1; i--) {            // Reverse BFS is deepest-first
+        out->pids[out->count++] = table->procs[slots[i]].pid;
+    }
+    free(slots); // Release traversal buffer
+    return n > 1 ? n - 1 : 0;
+}
+
+// Make sure the arena can hold capacity PIDs without further allocation
+int pid_arena_reserve(PidArena *arena, int capacity) {
+    if (capacity <= arena->capacity) return 0; // Already large enough
+    pid_t *grown = realloc(arena->pids, (size_t)capacity * sizeof(pid_t));
+    if (!grown) {
+        print_error("Cannot allocate PID arena", errno); // Out of memory
+        return -1;
+    }
+    arena->pids = grown;
+    arena->capacity = capacity;
+    return 0;
+}
+
+// Append one PID, doubling the block when it is full
+int pid_arena_push(PidArena *arena, pid_t pid) {
+    if (arena->count == arena->capacity &&
+        pid_arena_reserve(arena, arena->capacity ? arena->capacity * 2 : 256) == -1) {
+        return -1; // pid_arena_reserve already reported it
+    }
+    arena->pids[arena->count++] = pid;
+    return 0;
+}
+
+// Release the arena's block and leave it empty
+void pid_arena_free(PidArena *arena) {
+    free(arena->pids);
+    arena->pids = NULL;
+    arena->count = arena->capacity = 0;
+}
+
+// Determine if target_pid is in the tree rooted at root_pid
+int is_in_tree(const ProcessTable *table, pid_t root_pid, pid_t target_pid) {
+    if (root_pid == target_pid) return 1; // Base case: same process
+
+    int slot = snapshot_slot(table, target_pid); // Locate target
+    int root = snapshot_slot(table, root_pid);   // Locate root
+    if (slot < 0 || root < 0) return 0;          // Either one doesn’t exist
+
+    COUNT(tree_checks, 1);
+    return table->tin[root] <= table->tin[slot] && table->tin[slot] < table->tout[root]; // Inside root's DFS interval
+}
+
+// Display basic process info for no-option case
+void print_basic_info(const ProcessTable *table, pid_t pid) {
+    const ProcessInfo *info = snapshot_find(table, pid); // Fetch process details
+    if (!info) {
+        fprintf(stderr, "Error: Cannot get information for process %d\n", pid); // Alert if inaccessible
+        return;
+    }
+    out_text("PID: %d, PPID: %d\n", info->pid, info->ppid); // Print requested info
+    out_record(OUT_PROCESS, (long long[]){info->pid, info->ppid}, NULL);
+}
+
+// ---------------------------------------------------------------------------
+// Listing pipeline: source -> relation -> state -> sink over the snapshot's DFS
+// columns. run_pipeline() is always inlined and every handler passes constant
+// stages, so each option compiles to its own loop with the unused tests folded
+// away. The leading filter runs through a column kernel; the rest are scalar.
+// ---------------------------------------------------------------------------
+
+// DFS rows of the descendants exactly depth levels below pid, in BFS order; *rows is NULL when there are none
+static int level_rows(const ProcessTable *table, pid_t pid, int depth, int **rows) {
+    *rows = NULL;
+    int start = snapshot_slot(table, pid); // Locate target in snapshot
+    if (start < 0 || depth <= 0) return 0; // No record, or level 0 asked: no descendants
+
+    int *queue = malloc((size_t)table->count * sizeof(int)); // Holds each visited level in turn
+    if (!queue) {
+        print_error("Cannot allocate level queue", errno); // Out of memory
+        return -1;
+    }
+
+    int level_begin = 0, level_end = 1; // Current level occupies queue[level_begin .. level_end)
+    queue[0] = start;                   // Level 0 is the target itself
+    for (int level = 0; level < depth && level_begin < level_end; level++) {
+        int tail = level_end; // Next level is appended after the current one
+        for (int i = level_begin; i < level_end; i++) {
+            int slot = queue[i];
+            for (int c = table->child_start[slot]; c < table->child_start[slot + 1]; c++) {
+                int child = table->child_slots[c];
+                if (child == start) continue; // Never re-enter the target through a parent cycle
+                queue[tail++] = child;        // Queue child for the next level
+            }
+        }
+        level_begin = level_end; // Advance to the level just built
+        level_end = tail;
+    }
+
+    int n = level_end - level_begin; // Slots of the last level built, as rows
+    if (n == 0) {
+        free(queue); // Level is empty: nothing to hand back
+        return 0;
+    }
+    for (int i = 0; i < n; i++) queue[i] = table->tin[queue[level_begin + i]];
+    *rows = queue;
+    return n;
+}
+
+// Run one listing: candidates from source (levels deep for SOURCE_LEVEL), kept if they stand in
+// relation to pid and are in state (0 for any), then listed or counted; returns matches or -1
+PIPELINE_INLINE long run_pipeline(const ProcessTable *table, pid_t pid, int source, int levels,
+                                  int relation, char state, int sink) {
+    pid_t key = pid; // Parent PID the relation tests against
+    if (relation == RELATION_SIBLING) {
+        const ProcessInfo *info = snapshot_find(table, pid); // Get target's parent info
+        if (!info) {
+            fprintf(stderr, "Error: Cannot get information for process %d\n", pid); // Target inaccessible
+            return -1;
+        }
+        key = info->ppid;
+    }
+
+    // Source and leading filter: rows[i] + first are the surviving DFS rows
+    int first = 0, n;
+    int *rows;
+    int lead_state = source != SOURCE_LEVEL && state;                             // Zombies are the rarer filter
+    int lead_relation = source != SOURCE_LEVEL && !state && relation != RELATION_ANY;
+    if (source == SOURCE_LEVEL) {
+        n = level_rows(table, pid, levels, &rows);
+        if (n <= 0) return n;
+    } else {
+        if (source == SOURCE_TABLE) n = table->count;
+        else first = snapshot_range(table, pid, &n);
+        if (source == SOURCE_DESCENDANTS && n > 0) { // Row 0 of the run is pid itself
+            first++;
+            n--;
+        }
+        if (n <= 0) return 0;
+        rows = select_buffer(n);
+        if (!rows) return -1;
+        if (lead_state) n = column_select_state(table->dfs_state + first, n, state, rows);
+        else if (lead_relation) n = column_select_ppid(table->dfs_ppid + first, n, key, relation != RELATION_NOT_CHILD, rows);
+        else for (int i = 0; i < n; i++) rows[i] = i;
+    }
+
+    // Remaining filters, then the sink
+    long hits = 0;
+    for (int i = 0; i < n; i++) {
+        int row = first + rows[i];
+        pid_t ppid = table->dfs_ppid[row];
+        if (!lead_relation) {
+            if (relation == RELATION_CHILD && ppid != key) continue;
+            if (relation == RELATION_NOT_CHILD && ppid == key) continue;
+            if (relation == RELATION_SIBLING && ppid != key) continue;
+        }
+        if (relation == RELATION_SIBLING && table->dfs_pid[row] == pid) continue; // Not self
+        if (!lead_state && state && table->dfs_state[row] != state) continue;
+        if (sink == SINK_LIST) out_pid(table->dfs_pid[row]);
+        hits++;
+    }
+    free(rows);
+    return hits;
+}
+
+// Count zombie processes in the tree, pid included; read from the rollup shared with -sum and -agg
+int count_defunct_descendants(const ProcessTable *table, pid_t pid) {
+    Rollup rollup; // Counts only; no extended fields needed
+    if (rollup_build(table, pid, SNAPSHOT_BASIC, &rollup) == -1) return -1; // Indicate error
+    long count = rollup.n ? rollup.zombies[0] : 0; // Row 0 is pid itself
+    rollup_free(&rollup);
+    return (int)count; // Return total zombies found
+}
+
+// List processes deeper than direct children
+void list_non_direct_descendants(const ProcessTable *table, pid_t pid) {
+    run_pipeline(table, pid, SOURCE_DESCENDANTS, 0, RELATION_NOT_CHILD, 0, SINK_LIST);
+}
+
+// Show immediate children of the process
+void list_immediate_descendants(const ProcessTable *table, pid_t pid) {
+    run_pipeline(table, pid, SOURCE_LEVEL, 1, RELATION_ANY, 0, SINK_LIST);
+}
+
+// List processes sharing the same parent
+void list_siblings(const ProcessTable *table, pid_t pid) {
+    run_pipeline(table, pid, SOURCE_TABLE, 0, RELATION_SIBLING, 0, SINK_LIST);
+}
+
+// List only zombie siblings
+void list_defunct_siblings(const ProcessTable *table, pid_t pid) {
+    run_pipeline(table, pid, SOURCE_TABLE, 0, RELATION_SIBLING, 'Z', SINK_LIST);
+}
+
+// List all zombie descendants except the target
+void list_defunct_descendants(const ProcessTable *table, pid_t pid) {
+    run_pipeline(table, pid, SOURCE_DESCENDANTS, 0, RELATION_ANY, 'Z', SINK_LIST);
+}
+
+// List all grandchildren of the target process
+void list_grandchildren(const ProcessTable *table, pid_t pid) {
+    list_descendants_at_depth(table, pid, 2); // Grandchildren sit two levels down
+}
+
+// List descendants exactly depth levels below pid
+void list_descendants_at_depth(const ProcessTable *table, pid_t pid, int depth) {
+    run_pipeline(table, pid, SOURCE_LEVEL, depth, RELATION_ANY, 0, SINK_LIST);
+}
+
+// List grandchildren that are stopped (state T)
+void list_stopped_grandchildren(const ProcessTable *table, pid_t pid) {
+    run_pipeline(table, pid, SOURCE_LEVEL, 2, RELATION_ANY, 'T', SINK_LIST);
+}
+
+// Display whether the process is defunct or active
+void print_status(const ProcessTable *table, pid_t pid) {
+    const ProcessInfo *info = snapshot_find(table, pid); // Get process state
+    if (!info) {
+        fprintf(stderr, "Error: Cannot get status for process %d\n", pid); // Status fetch failed
+        return;
+    }
+    out_text("Process %d is %s\n", pid, (info->state == 'Z') ? "Defunct" : "Not Defunct"); // Report status
+    out_record(OUT_STATUS, (long long[]){pid, info->state == 'Z'}, NULL);
+}
+
+// Print process, zombie and thread counts plus total RSS and CPU time of pid's subtree, pid included
+void print_subtree_totals(const ProcessTable *table, pid_t pid) {
+    Rollup rollup; // Row 0 holds the totals for pid's whole subtree
+    if (rollup_build(table, pid, SNAPSHOT_EXTENDED, &rollup) == -1 || rollup.n == 0) {
+        rollup_free(&rollup);
+        return;
+    }
+
+    long page_kib = sysconf(_SC_PAGESIZE) / 1024; // rss is in pages
+    double ticks = (double)sysconf(_SC_CLK_TCK);  // utime/stime are in clock ticks
+    out_text("Subtree of %d: %ld processes (%ld defunct), %ld threads\n", pid, rollup.procs[0], rollup.zombies[0], rollup.threads[0]);
+    out_text("Total RSS: %ld KiB\n", rollup.rss[0] * page_kib);
+    out_text("Total CPU: %.2f s user, %.2f s system\n", rollup.utime[0] / ticks, rollup.stime[0] / ticks);
+    out_record(OUT_SUBTREE, (long long[]){pid, rollup.procs[0], rollup.zombies[0], rollup.threads[0], rollup.rss[0] * page_kib,
+               (long long)(rollup.utime[0] * 1000 / ticks), (long long)(rollup.stime[0] * 1000 / ticks)},
+               snapshot_ext(table, snapshot_slot(table, pid))->comm);
+    rollup_free(&rollup);
+}
+
+// Rank pid's child subtrees by total RSS and print the top ones with their process, zombie and CPU totals
+void print_subtree_ranking(const ProcessTable *table, pid_t pid, int top) {
+    Rollup rollup; // Totals for every node under pid
+    if (rollup_build(table, pid, SNAPSHOT_EXTENDED, &rollup) == -1 || rollup.n == 0) {
+        rollup_free(&rollup);
+        return;
+    }
+    int slot = snapshot_slot(table, pid);
+    int nchildren = table->child_start[slot + 1] - table->child_start[slot];
+    int *order = select_buffer(nchildren); // Child indexes into the rollup, heaviest first
+    if (!order) {
+        rollup_free(&rollup);
+        return;
+    }
+    int ranked = 0;
+    for (int c = table->child_start[slot]; c < table->child_start[slot + 1]; c++) {
+        int i = table->tin[table->child_slots[c]] - rollup.first;
+        if (i <= 0 || i >= rollup.n) continue; // A cycle's entry is not a child subtree
+        int at = ranked < top ? ranked++ : top; // Insertion into the top-K list
+        while (at > 0 && rollup.rss[order[at - 1]] < rollup.rss[i]) {
+            if (at < top) order[at] = order[at - 1];
+            at--;
+        }
+        if (at < top) order[at] = i;
+    }
+
+    long page_kib = sysconf(_SC_PAGESIZE) / 1024; // rss is in pages
+    double ticks = (double)sysconf(_SC_CLK_TCK);  // utime/stime are in clock ticks
+    out_text("Subtree of %d (%s): %ld processes (%ld defunct), %ld threads, %ld KiB RSS, %.2f s CPU\n", pid,
+             snapshot_ext(table, slot)->comm, rollup.procs[0], rollup.zombies[0], rollup.threads[0],
+             rollup.rss[0] * page_kib, (rollup.utime[0] + rollup.stime[0]) / ticks);
+    out_text("Top %d of %d child subtrees by RSS:\n", ranked, nchildren);
+    out_text("%8s %8s %8s %8s %12s %10s  %s\n", "PID", "PROCS", "DEFUNCT", "THREADS", "RSS_KIB", "CPU_S", "COMM");
+    for (int k = -1; k < ranked; k++) { // k = -1 is the target's own subtree
+        int i = k < 0 ? 0 : order[k];
+        int row = rollup.first + i;
+        const char *comm = snapshot_ext(table, table->dfs_slot[row])->comm;
+        if (k >= 0) {
+            out_text("%8d %8ld %8ld %8ld %12ld %10.2f  %s\n", table->dfs_pid[row], rollup.procs[i], rollup.zombies[i],
+                     rollup.threads[i], rollup.rss[i] * page_kib, (rollup.utime[i] + rollup.stime[i]) / ticks, comm);
+        }
+        out_record(k < 0 ? OUT_SUBTREE : OUT_CHILD_SUBTREE,
+                   (long long[]){table->dfs_pid[row], rollup.procs[i], rollup.zombies[i], rollup.threads[i], rollup.rss[i] * page_kib,
+                   (long long)(rollup.utime[i] * 1000 / ticks), (long long)(rollup.stime[i] * 1000 / ticks)}, comm);
+    }
+    free(order);
+    rollup_free(&rollup);
+}
+
+// Leaves by command name, then state, then DFS row, so identical workers form runs in child order
+static int tree_leaf_order(const void *a, const void *b) {
+    const TreeLeaf *x = a, *y = b;
+    int by_comm = strcmp(x->comm, y->comm);
+    if (by_comm) return by_comm;
+    if (x->state != y->state) return x->state < y->state ? -1 : 1;
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+// Heaviest first by --rank, then in child order
+static int tree_rank_order(const void *a, const void *b) {
+    const TreeEntry *x = a, *y = b;
+    long wx = run_options.rank == RANK_RSS ? x->rss : x->procs;
+    long wy = run_options.rank == RANK_RSS ? y->rss : y->procs;
+    if (wx != wy) return wx > wy ? -1 : 1;
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+// Child order only, when nothing is pruned
+static int tree_row_order(const void *a, const void *b) {
+    const TreeEntry *x = a, *y = b;
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+// Fill frame with the children of rollup node i: leaves collapsed into runs, then ranked and cut to --top
+static int tree_children(const ProcessTable *table, const Rollup *rollup, int i, TreeFrame *frame) {
+    int slot = table->dfs_slot[rollup->first + i];
+    int nchildren = table->child_start[slot + 1] - table->child_start[slot];
+    TreeEntry *entries = malloc(((size_t)nchildren + 1) * sizeof(TreeEntry));
+    TreeLeaf *leaves = malloc(((size_t)nchildren + 1) * sizeof(TreeLeaf));
+    if (!entries || !leaves) {
+        print_error("Cannot allocate tree level", errno); // Out of memory
+        free(entries);
+        free(leaves);
+        return -1;
+    }
+
+    int n = 0, nleaves = 0;
+    for (int c = table->child_start[slot]; c < table->child_start[slot + 1]; c++) {
+        int child = table->tin[table->child_slots[c]] - rollup->first;
+        if (child <= 0 || child >= rollup->n) continue; // A cycle's entry is not a child subtree
+        if (rollup->procs[child] > 1) {
+            entries[n++] = (TreeEntry){child, 1, rollup->procs[child], rollup->rss[child]};
+            continue;
+        }
+        TreeLeaf *leaf = &leaves[nleaves++];
+        memcpy(leaf->comm, snapshot_ext(table, table->dfs_slot[rollup->first + child])->comm, sizeof(leaf->comm));
+        leaf->state = table->dfs_state[rollup->first + child];
+        leaf->row = child;
+    }
+    qsort(leaves, (size_t)nleaves, sizeof(TreeLeaf), tree_leaf_order);
+    for (int j = 0; j < nleaves;) { // One entry per run of equal (comm, state)
+        int k = j + 1;
+        long rss = rollup->rss[leaves[j].row];
+        while (k < nleaves && strcmp(leaves[k].comm, leaves[j].comm) == 0 && leaves[k].state == leaves[j].state) {
+            rss += rollup->rss[leaves[k++].row];
+        }
+        entries[n++] = (TreeEntry){leaves[j].row, k - j, k - j, rss};
+        j = k;
+    }
+    free(leaves);
+
+    qsort(entries, (size_t)n, sizeof(TreeEntry), run_options.top ? tree_rank_order : tree_row_order);
+    *frame = (TreeFrame){entries, n, 0, 0, 0, 0};
+    if (run_options.top && n > run_options.top) { // Keep the heaviest; summarise the rest in one line
+        frame->n = run_options.top;
+        frame->hidden = n - run_options.top;
+        for (int j = run_options.top; j < n; j++) frame->hidden_procs += entries[j].procs;
+    }
+    return 0;
+}
+
+// Print one tree line: "PID comm [descendants]" for a process, "comm ×N" for a collapsed run
+static void tree_line(const ProcessTable *table, const Rollup *rollup, const char *indent, const char *branch,
+                      int depth, const TreeEntry *entry) {
+    int row = rollup->first + entry->row;
+    pid_t pid = table->dfs_pid[row];
+    const char *comm = snapshot_ext(table, table->dfs_slot[row])->comm;
+    char state = table->dfs_state[row];
+    const char *mark = state == 'Z' ? " <defunct>" : state == 'T' ? " <stopped>" : "";
+    long rss_kib = entry->rss * (sysconf(_SC_PAGESIZE) / 1024); // rss is in pages
+    char memory[32] = "";                                         // Shown when ranking by it
+    if (run_options.rank == RANK_RSS) snprintf(memory, sizeof(memory), " %ld KiB", rss_kib);
+
+    if (entry->count > 1) out_text("%s%s%s%s ×%d%s\n", indent, branch, comm, mark, entry->count, memory);
+    else if (entry->procs > 1) out_text("%s%s%d %s%s [%ld]%s\n", indent, branch, pid, comm, mark, entry->procs - 1, memory);
+    else out_text("%s%s%d %s%s%s\n", indent, branch, pid, comm, mark, memory);
+    out_record(OUT_TREE_NODE, (long long[]){depth, pid, entry->count > 1 ? 0 : entry->procs - 1, rss_kib, entry->count}, comm);
+}
+
+// Render pid's subtree from the children index, indented, pruned by --max-depth and --top, with runs
+// of identical leaf workers collapsed. Only the lines kept are formatted, all into the output buffer.
+void print_tree(const ProcessTable *table, pid_t pid) {
+    Rollup rollup; // Subtree sizes and RSS for every node, for labels and ranking
+    if (rollup_build(table, pid, SNAPSHOT_EXTENDED, &rollup) == -1 || rollup.n == 0) {
+        rollup_free(&rollup);
+        return;
+    }
+    TreeEntry root = {0, 1, rollup.procs[0], rollup.rss[0]};
+    tree_line(table, &rollup, "", "", 0, &root);
+
+    TreeFrame *stack = NULL;          // stack[d - 1] prints the nodes at depth d
+    int depth = 0, capacity = 0;
+    char *indent = NULL;              // "│  " or "   " per open ancestor
+    size_t indent_capacity = 0;
+    int expand = rollup.procs[0] > 1 && run_options.max_depth != 0;
+    int expand_row = 0;               // Node whose children go on the stack next
+    for (;;) {
+        if (expand) {
+            if (depth == capacity) {
+                int grown_capacity = capacity ? capacity * 2 : 16;
+                TreeFrame *grown = realloc(stack, (size_t)grown_capacity * sizeof(TreeFrame));
+                if (!grown) {
+                    print_error("Cannot allocate tree stack", errno); // Out of memory
+                    break;
+                }
+                stack = grown;
+                capacity = grown_capacity;
+            }
+            size_t indent_len = depth ? stack[depth - 1].indent_len : 0;
+            if (depth) { // Continue the parent's rail unless the node just printed was its last line
+                const TreeFrame *up = &stack[depth - 1];
+                const char *rail = up->next == up->n && up->hidden == 0 ? "   " : "│  ";
+                size_t rail_len = strlen(rail);
+                if (indent_len + rail_len + 1 > indent_capacity) {
+                    size_t grown_capacity = indent_capacity ? indent_capacity * 2 : 256;
+                    while (grown_capacity < indent_len + rail_len + 1) grown_capacity *= 2;
+                    char *grown = realloc(indent, grown_capacity);
+                    if (!grown) {
+                        print_error("Cannot allocate tree indent", errno); // Out of memory
+                        break;
+                    }
+                    indent = grown;
+                    indent_capacity = grown_capacity;
+                }
+                memcpy(indent + indent_len, rail, rail_len);
+                indent_len += rail_len;
+            }
+            if (tree_children(table, &rollup, expand_row, &stack[depth]) == -1) break;
+            stack[depth++].indent_len = indent_len;
+            expand = 0;
+        }
+        if (depth == 0) break;
+
+        TreeFrame *frame = &stack[depth - 1];
+        if (indent) indent[frame->indent_len] = '\0'; // Drop whatever deeper levels appended
+        const char *prefix = indent ? indent : "";
+        if (frame->next < frame->n) {
+            const TreeEntry *entry = &frame->entries[frame->next++];
+            int last = frame->next == frame->n && frame->hidden == 0;
+            tree_line(table, &rollup, prefix, last ? "└─ " : "├─ ", depth, entry);
+            if (entry->count == 1 && entry->procs > 1 && (run_options.max_depth < 0 || depth < run_options.max_depth)) {
+                expand = 1; // Its children are printed before its next sibling
+                expand_row = entry->row;
+            }
+        } else if (frame->hidden) {
+            out_text("%s└─ … %d more (%ld process%s)\n", prefix, frame->hidden, frame->hidden_procs,
+                     frame->hidden_procs == 1 ? "" : "es");
+            out_record(OUT_TREE_MORE, (long long[]){depth, frame->hidden, frame->hidden_procs}, NULL);
+            frame->hidden = 0;
+        } else {
+            free(frame->entries); // Node finished
+            depth--;
+        }
+    }
+    while (depth > 0) free(stack[--depth].entries); // Only after an allocation failure
+    free(stack);
+    free(indent);
+    rollup_free(&rollup);
+}
+
+// Most zombies first, then lowest PID, so the worst leakers are reaped first
+static int zombie_parent_order(const void *a, const void *b) {
+    const ZombieParent *x = a, *y = b;
+    if (x->zombies != y->zombies) return x->zombies > y->zombies ? -1 : 1;
+    return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+// Terminate parents of zombie descendants: each parent once, ranked by its zombie count
+void kill_zombie_parents(const ProcessTable *table, pid_t pid) {
+    int n;                                      // Subtree of pid, pid included: a zombie target counts too
+    int first = snapshot_range(table, pid, &n);
+    int *rows = n > 0 ? select_buffer(n) : NULL;
+    int *rank = n > 0 ? calloc((size_t)table->count + 1, sizeof(int)) : NULL; // Per slot: zombie children, later rank + 1
+    if (n > 0 && (!rows || !rank)) {
+        if (rows && !rank) print_error("Cannot allocate zombie parent index", errno); // Out of memory
+        free(rows);
+        free(rank);
+        return;
+    }
+
+    // Group the subtree's zombies by parent slot; the slot is a dense key, so no hashing is needed
+    int hits = n > 0 ? column_select_state(table->dfs_state + first, n, 'Z', rows) : 0;
+    int nparents = 0;
+    for (int i = 0; i < hits; i++) {
+        int parent = snapshot_parent(table, table->dfs_slot[first + rows[i]]);
+        if (parent >= 0 && rank[parent]++ == 0) nparents++; // Parent unknown or its PID already reused: skip
+    }
+    ZombieParent *parents = malloc(((size_t)nparents + 1) * sizeof(ZombieParent));
+    if (!parents) {
+        print_error("Cannot allocate zombie parent list", errno); // Out of memory
+        free(rows);
+        free(rank);
+        return;
+    }
+    int listed = 0;
+    for (int i = 0; i < hits; i++) {
+        int parent = snapshot_parent(table, table->dfs_slot[first + rows[i]]);
+        if (parent < 0 || rank[parent] <= 0) continue; // Already listed
+        if (rank[parent] >= run_options.min_zombies) {
+            parents[listed++] = (ZombieParent){table->procs[parent].pid, parent, rank[parent]};
+        }
+        rank[parent] = 0;
+    }
+    qsort(parents, (size_t)listed, sizeof(ZombieParent), zombie_parent_order);
+    for (int k = 0; k < listed; k++) rank[parents[k].slot] = k + 1; // Zombie rows find their parent's entry
+
+    if (listed == 0) { // If no zombies were found to act on
+        if (run_options.min_zombies > 1) {
+            out_text("No parent of %d or more zombie processes found among descendants of %d\n", run_options.min_zombies, pid);
+        } else {
+            out_text("No zombie processes found among descendants of %d\n", pid); // Inform user
+        }
+        out_record(OUT_NO_ZOMBIES, (long long[]){pid}, NULL);
+    } else if (run_options.dry_run) {
+        for (int k = 0; k < listed; k++) {
+            out_text("Would kill parent %d of %d zombie process%s\n", parents[k].pid, parents[k].zombies,
+                     parents[k].zombies == 1 ? "" : "es");
+            out_record(OUT_ZOMBIE_PARENT, (long long[]){parents[k].pid, parents[k].zombies, 0}, NULL);
+        }
+    } else {
+        SignalBatch batch = {0}; // Ranked parents, pinned and checked against the snapshot
+        if (pid_arena_reserve(&batch.victims, listed) == 0) {
+            for (int k = 0; k < listed; k++) batch.victims.pids[batch.victims.count++] = parents[k].pid;
+        }
+        if (batch.victims.count == listed && signal_batch_pin(&batch, table) == 0) {
+            double started = monotonic_ms();
+            for (int k = 0; k < listed; k++) {
+                const ZombieParent *p = &parents[k];
+                if (signal_batch_send(&batch, k, SIGKILL) == 0) {
+                    if (!run_options.verbose) {
+                        out_text("Killed parent %d of %d zombie process%s\n", p->pid, p->zombies, p->zombies == 1 ? "" : "es");
+                    }
+                    out_record(OUT_ZOMBIE_PARENT, (long long[]){p->pid, p->zombies, 1}, NULL);
+                    continue;
+                }
+                rank[p->slot] = 0; // No per-zombie lines for a parent that was not killed
+                if (signal_skip_reason(batch.pidfds[k])) {
+                    fprintf(stderr, "Warning: Skipped parent %d of %d zombies: %s\n", p->pid, p->zombies,
+                            signal_skip_reason(batch.pidfds[k]));
+                    continue;
+                }
+                char msg[64];                     // Buffer for custom error
+                snprintf(msg, sizeof(msg), "Failed to kill parent %d of %d zombies", p->pid, p->zombies);
+                print_error(msg, errno);          // Report kill failure
+            }
+            phase_ms[PHASE_SIGNAL] += monotonic_ms() - started;
+
+            for (int i = 0; run_options.verbose && i < hits; i++) { // One line per zombie whose parent was killed
+                int parent = snapshot_parent(table, table->dfs_slot[first + rows[i]]);
+                if (parent < 0 || rank[parent] == 0) continue;
+                out_text("Killed parent %d of zombie process %d\n", table->procs[parent].pid, table->dfs_pid[first + rows[i]]);
+                out_record(OUT_PARENT_KILLED, (long long[]){table->procs[parent].pid, table->dfs_pid[first + rows[i]]}, NULL);
+            }
+        }
+        signal_batch_free(&batch);
+    }
+    free(parents);
+    free(rows);
+    free(rank);
+}
+
+// Warning text for a victim skipped while pinning, or NULL for any other marker or result
+static const char *signal_skip_reason(int marker) {
+    if (marker == SIGNAL_SKIP_REUSED) return "PID was reused after the scan";
+    if (marker == SIGNAL_SKIP_MOVED) return "process was reparented after the scan";
+    if (marker == SIGNAL_SKIP_UNCHECKED) return "no file descriptor left to re-check it";
+    return NULL;
+}
+
+// Report why a pinned victim could not be signalled; err is its SignalChunk result
+static void report_signal_failure(const SignalBatch *batch, int i, const char *what, int err) {
+    char msg[96]; // Buffer for error message
+    if (signal_skip_reason(err)) {
+        fprintf(stderr, "Warning: Skipped descendant %d: %s\n", batch->victims.pids[i], signal_skip_reason(err));
+        return;
+    }
+    snprintf(msg, sizeof(msg), "Failed to %s descendant %d", what, batch->victims.pids[i]);
+    print_error(msg, err);
+}
+
+// Signal one range of a level; runs on a worker thread or inline
+static void *signal_chunk(void *arg) {
+    SignalChunk *chunk = arg;
+    for (int i = chunk->begin; i < chunk->end; i++) {
+        int marker = chunk->batch->pidfds[i];
+        if (signal_batch_send(chunk->batch, i, chunk->sig) == 0) chunk->result[i] = 0;
+        else if (signal_skip_reason(marker)) chunk->result[i] = marker;
+        else chunk->result[i] = errno; // errno is per thread
+    }
+    return NULL;
+}
+
+// Signal victims [begin, end), split across --jobs workers when the level is large enough
+static void dispatch_level(const SignalBatch *batch, int begin, int end, int sig, int *result) {
+    int jobs = run_options.jobs;
+    if (jobs > (end - begin) / SIGNAL_PARALLEL_MIN) jobs = (end - begin) / SIGNAL_PARALLEL_MIN;
+    if (jobs < 1) jobs = 1;
+    SignalChunk chunks[1024];    // --jobs is capped at 1024
+    pthread_t threads[1024];     // Worker handles, parallel to chunks
+    int started[1024] = {0};     // Whether chunks[j] runs on its own thread
+    int per_chunk = (end - begin + jobs - 1) / jobs;
+    for (int j = 0; j < jobs; j++) {
+        int first = begin + j * per_chunk;
+        int last = first + per_chunk < end ? first + per_chunk : end;
+        chunks[j] = (SignalChunk){batch, first, last > first ? last : first, sig, result};
+        if (j > 0) started[j] = pthread_create(&threads[j], NULL, signal_chunk, &chunks[j]) == 0;
+    }
+    signal_chunk(&chunks[0]);                               // Do our own share meanwhile
+    for (int j = 1; j < jobs; j++) {
+        if (started[j]) pthread_join(threads[j], NULL);     // The level is done only when every worker is
+        else signal_chunk(&chunks[j]);                      // Thread creation failed; signal inline
+    }
+}
+
+// Depth of pid in table, so runs of equal depth in a victim list can be told apart
+static int victim_depth(const ProcessTable *table, pid_t pid) {
+    int slot = snapshot_slot(table, pid);
+    return slot >= 0 ? table->depth[slot] : DEPTH_CYCLE;
+}
+
+// Tally results per outcome. With --verbose, print "<done> descendant N" per success (unless done
+// is NULL) and each failure; otherwise one "<done> N descendants" line and one line per cause
+static int report_signal_outcomes(const SignalBatch *batch, const int *result, int sig, const char *what, const char *done) {
+    long tally[SIGNAL_ERRNO_LIMIT] = {0}; // [0]: delivered; [e]: failed with errno e
+    long reused = 0, moved = 0, unchecked = 0; // Skipped while pinning
+    int n = batch->victims.count;
+    for (int i = 0; i < n; i++) {
+        int r = result[i];
+        if (r == SIGNAL_SKIP_REUSED) reused++;
+        else if (r == SIGNAL_SKIP_MOVED) moved++;
+        else if (r == SIGNAL_SKIP_UNCHECKED) unchecked++;
+        else tally[r < SIGNAL_ERRNO_LIMIT ? r : SIGNAL_ERRNO_LIMIT - 1]++;
+        if (!run_options.verbose) continue;
+        if (r != 0) {
+            report_signal_failure(batch, i, what, r); // Report failure, keep going
+        } else if (done) {
+            out_text("%s descendant %d\n", done, batch->victims.pids[i]); // Confirm delivery
+            out_record(OUT_SIGNALLED, (long long[]){batch->victims.pids[i], sig}, NULL);
+        }
+    }
+
+    if (done) {
+        if (tally[0] == n) out_text("%s %ld descendants\n", done, tally[0]);
+        else out_text("%s %ld of %d descendants\n", done, tally[0], n);
+        for (int e = 0; e < SIGNAL_ERRNO_LIMIT; e++) {
+            if (e == 0 || tally[e]) out_record(OUT_SIGNAL_OUTCOME, (long long[]){sig, e, tally[e]}, NULL);
+        }
+        if (reused) out_record(OUT_SIGNAL_OUTCOME, (long long[]){sig, SIGNAL_SKIP_REUSED, reused}, NULL);
+        if (moved) out_record(OUT_SIGNAL_OUTCOME, (long long[]){sig, SIGNAL_SKIP_MOVED, moved}, NULL);
+        if (unchecked) out_record(OUT_SIGNAL_OUTCOME, (long long[]){sig, SIGNAL_SKIP_UNCHECKED, unchecked}, NULL);
+    }
+    if (!run_options.verbose) { // Failures, one line per cause
+        for (int e = 1; e < SIGNAL_ERRNO_LIMIT; e++) {
+            if (tally[e]) fprintf(stderr, "Error: Failed to %s %ld descendants: %s\n", what, tally[e], strerror(e));
+        }
+        if (reused) fprintf(stderr, "Warning: Skipped %ld descendants: PID was reused after the scan\n", reused);
+        if (moved) fprintf(stderr, "Warning: Skipped %ld descendants: process was reparented after the scan\n", moved);
+        if (unchecked) fprintf(stderr, "Warning: Skipped %ld descendants: %s\n", unchecked, signal_skip_reason(SIGNAL_SKIP_UNCHECKED));
+    }
+    return (int)tally[0];
+}
+
+// Signal every pinned victim, one level at a time in list order: each run of equal depth in
+// table is spread across the --jobs workers, and the next run starts only once it is done
+static int deliver_batch(const SignalBatch *batch, const ProcessTable *table, int sig, const char *what, const char *done) {
+    int n = batch->victims.count;
+    if (n == 0) return 0;
+    int *result = malloc((size_t)n * sizeof(int)); // Written by the workers, read once they are joined
+    if (!result) {
+        print_error("Cannot allocate signal results", errno); // Out of memory
+        return 0;
+    }
+    double started = monotonic_ms();
+    for (int begin = 0; begin < n;) {
+        int depth = victim_depth(table, batch->victims.pids[begin]);
+        int end = begin + 1;
+        while (end < n && victim_depth(table, batch->victims.pids[end]) == depth) end++;
+        dispatch_level(batch, begin, end, sig, result);
+        begin = end;
+    }
+    phase_ms[PHASE_SIGNAL] += monotonic_ms() - started;
+    int delivered = report_signal_outcomes(batch, result, sig, what, done);
+    free(result);
+    return delivered;
+}
+
+// Collect pid's descendants in BFS order (parents before children), optionally only those in state
+static int collect_descendants_top_down(const ProcessTable *table, pid_t pid, char state, PidArena *out) {
+    int *slots;                                 // Subtree of pid, pid included
+    int n = snapshot_subtree(table, pid, &slots);
+    if (n < 0) return -1;
+    if (n > 1 && pid_arena_reserve(out, out->count + n - 1) == -1) {
+        free(slots);
+        return -1;
+    }
+    for (int i = 1; i < n; i++) {               // Skip the target itself
+        const ProcessInfo *info = &table->procs[slots[i]];
+        if (!state || info->state == state) out->pids[out->count++] = info->pid;
+    }
+    free(slots); // Release traversal buffer
+    return 0;
+}
+
+// Mark pid in a PID-indexed byte map, growing it on demand; returns 1 if it was newly marked
+static int pid_map_mark(unsigned char **map, pid_t *size, pid_t pid) {
+    if (pid >= *size) {
+        pid_t new_size = pid + 1 > *size * 2 ? pid + 1 : *size * 2;
+        unsigned char *grown = realloc(*map, (size_t)new_size);
+        if (!grown) return 1; // Treat as new; SIGSTOP twice is harmless
+        memset(grown + *size, 0, (size_t)(new_size - *size));
+        *map = grown;
+        *size = new_size;
+    }
+    if ((*map)[pid]) return 0;
+    (*map)[pid] = 1;
+    return 1;
+}
+
+// Remove this process from a victim list: run from inside the target's subtree, -sk and -st
+// would otherwise stop or kill themselves before the rest of the tree
+static void drop_self(PidArena *victims) {
+    pid_t self = getpid();
+    int kept = 0;
+    for (int i = 0; i < victims->count; i++) {
+        if (victims->pids[i] != self) victims->pids[kept++] = victims->pids[i];
+    }
+    victims->count = kept;
+}
+
+// Terminate all descendants with SIGKILL, ensuring grandchildren are included
+void kill_descendants(const ProcessTable *table, pid_t pid) {
+    // Fast path: one write kills the whole subtree when it is exactly one cgroup
+    if (run_options.cgroup) {
+        PidArena all = {0};
+        char cgroup_dir[4096];
+        if (collect_descendants_deepest_first(table, pid, &all) == -1) return;
+        if (cgroup_match_subtree(table, pid, &all, cgroup_dir, sizeof(cgroup_dir)) == 1) {
+            if (cgroup_write(cgroup_dir, "cgroup.kill", "1") == 0) {
+                out_text("Killed %d descendants via %s/cgroup.kill\n", all.count, cgroup_dir);
+                out_cgroup(all.count, 1, cgroup_dir, "cgroup.kill");
+                pid_arena_free(&all);
+                return;
+            }
+            print_error("cgroup.kill failed; signalling individually", errno); // Older kernel or no permission
+        }
+        pid_arena_free(&all);
+    }
+
+    // Freeze the tree first: SIGSTOP every descendant, top-down, then rescan and stop whatever
+    // was forked meanwhile, until a round finds nothing new. Stopped processes cannot fork,
+    // so the frozen set stops growing and the final kill cannot be outrun.
+    unsigned char *stopped = NULL; // PID-indexed: already sent SIGSTOP
+    pid_t stopped_size = 0;
+    ProcessTable rescan = {0};     // Latest snapshot; round 1 uses the caller's
+    const ProcessTable *view = table;
+    int converged = 0, round;
+    for (round = 1; round <= KILL_FREEZE_ROUNDS; round++) {
+        double started = monotonic_ms();
+        if (round > 1) {
+            snapshot_free(&rescan);
+            int status = snapshot_build_subtree(&rescan, pid, pid, -1, SNAPSHOT_BASIC); // Only the subtree can have grown
+            if (status == 1) status = snapshot_build(&rescan, SNAPSHOT_BASIC);
+            if (status == -1) break; // Already reported
+            view = &rescan;
+        }
+
+        SignalBatch batch = {0}; // Descendants not stopped in an earlier round
+        if (collect_descendants_top_down(view, pid, 0, &batch.victims) == -1) break;
+        int fresh = 0;
+        for (int i = 0; i < batch.victims.count; i++) {
+            pid_t victim = batch.victims.pids[i];
+            const ProcessInfo *info = snapshot_find(view, victim);
+            if (info->state == 'Z' || victim == getpid()) continue;     // Already dead, or this process
+            if (pid_map_mark(&stopped, &stopped_size, victim)) batch.victims.pids[fresh++] = victim;
+        }
+        batch.victims.count = fresh;
+        int frozen = 0;
+        if (fresh > 0 && signal_batch_pin(&batch, view) == 0) {
+            frozen = deliver_batch(&batch, view, SIGSTOP, "stop", NULL);
+        }
+        signal_batch_free(&batch);
+        fprintf(stderr, "Freeze round %d: stopped %d new descendants in %.2f ms\n", round, frozen, monotonic_ms() - started);
+        if (fresh == 0) {
+            converged = 1; // Fixpoint: nothing new appeared since the last round
+            break;
+        }
+    }
+    if (!converged) {
+        fprintf(stderr, "Warning: Subtree still growing after %d freeze rounds; killing what was frozen\n", KILL_FREEZE_ROUNDS);
+    }
+
+    // Kill the frozen set in one batch, deepest first, validated against the latest snapshot
+    double started = monotonic_ms();
+    SignalBatch batch = {0};
+    int collected = collect_descendants_deepest_first(view, pid, &batch.victims);
+    drop_self(&batch.victims);
+    if (collected >= 0 && signal_batch_pin(&batch, view) == 0) {
+        int killed = deliver_batch(&batch, view, SIGKILL, "kill", "Killed");
+        fprintf(stderr, "Kill: signalled %d descendants in %.2f ms after %d freeze rounds\n",
+                killed, monotonic_ms() - started, converged ? round : KILL_FREEZE_ROUNDS);
+    }
+    signal_batch_free(&batch);
+    snapshot_free(&rescan);
+    free(stopped);
+}
+
+// Pause all descendants with SIGSTOP
+void stop_descendants(const ProcessTable *table, pid_t pid) {
+    SignalBatch batch = {0};
+    if (collect_descendants_top_down(table, pid, 0, &batch.victims) == -1) return;
+    drop_self(&batch.victims);
+
+    char cgroup_dir[4096]; // Freezing the cgroup stops everything in one write
+    if (run_options.cgroup && cgroup_match_subtree(table, pid, &batch.victims, cgroup_dir, sizeof(cgroup_dir)) == 1) {
+        if (cgroup_write(cgroup_dir, "cgroup.freeze", "1") == 0) {
+            out_text("Froze %d descendants via %s/cgroup.freeze\n", batch.victims.count, cgroup_dir);
+            out_cgroup(batch.victims.count, 1, cgroup_dir, "cgroup.freeze");
+            signal_batch_free(&batch);
+            return;
+        }
+        print_error("cgroup.freeze failed; signalling individually", errno);
+    }
+
+    if (signal_batch_pin(&batch, table) == 0) {
+        deliver_batch(&batch, table, SIGSTOP, "stop", "Stopped"); // Top-down: parents before children
+    }
+    signal_batch_free(&batch); // Close pidfds
+}
+
+// Resume stopped descendants with SIGCONT
+void continue_descendants(const ProcessTable *table, pid_t pid) {
+    SignalBatch batch = {0};
+    if (run_options.cgroup) { // Thaw a cgroup frozen by -st --cgroup before sending SIGCONT
+        if (collect_descendants_top_down(table, pid, 0, &batch.victims) == -1) return;
+        char cgroup_dir[4096];
+        if (cgroup_match_subtree(table, pid, &batch.victims, cgroup_dir, sizeof(cgroup_dir)) == 1 &&
+            cgroup_write(cgroup_dir, "cgroup.freeze", "0") == 0) {
+            out_text("Thawed %d descendants via %s/cgroup.freeze\n", batch.victims.count, cgroup_dir);
+            out_cgroup(batch.victims.count, 0, cgroup_dir, "cgroup.freeze");
+        }
+        batch.victims.count = 0; // Reuse the arena for the stopped subset
+    }
+    if (collect_descendants_top_down(table, pid, 'T', &batch.victims) == -1) return; // Only stopped descendants
+    for (int i = 0, j = batch.victims.count - 1; i < j; i++, j--) { // Bottom-up: children resume before their parents
+        pid_t swap = batch.victims.pids[i];
+        batch.victims.pids[i] = batch.victims.pids[j];
+        batch.victims.pids[j] = swap;
+    }
+
+    if (signal_batch_pin(&batch, table) == 0) {
+        deliver_batch(&batch, table, SIGCONT, "continue", "Continued"); // Resume each stopped descendant
+    }
+    signal_batch_free(&batch); // Close pidfds
+}
+
+// ---------------------------------------------------------------------------
+// Signal delivery engine: victims are pinned with pidfds right after they are
+// resolved from the snapshot, so a PID recycled in the meantime is never hit.
+// A subtree that is exactly one cgroup v2 directory can be handled instead
+// with a single write to cgroup.kill or cgroup.freeze (--cgroup).
+// ---------------------------------------------------------------------------
+
+// Is pid still the snapshot's process, by (pid, starttime), hanging where the snapshot saw it?
+// Returns keep, or the SIGNAL_SKIP_* marker that says why not
+static int signal_verdict(const ProcessTable *table, pid_t pid, int keep) {
+    const ProcessInfo *seen = snapshot_find(table, pid);
+    errno = 0;
+    ProcessInfo now = get_process_info(pid);
+    if (now.pid == 0 && (errno == EMFILE || errno == ENFILE)) return SIGNAL_SKIP_UNCHECKED; // Never signal unchecked
+    if (!seen || now.pid != pid) return now.pid == 0 ? SIGNAL_SKIP_GONE : SIGNAL_SKIP_REUSED;
+    if (seen->starttime && now.starttime != seen->starttime) return SIGNAL_SKIP_REUSED;
+    if (now.ppid != seen->ppid) return seen->starttime ? SIGNAL_SKIP_MOVED : SIGNAL_SKIP_REUSED;
+    return keep;
+}
+
+// Open pidfds for every victim and confirm each still is the process the snapshot saw
+int signal_batch_pin(SignalBatch *batch, const ProcessTable *table) {
+    batch->pidfds = malloc(((size_t)batch->victims.count + 1) * sizeof(int));
+    if (!batch->pidfds) {
+        print_error("Cannot allocate pidfd table", errno); // Out of memory
+        return -1;
+    }
+
+    static int raised = 0; // Large subtrees need more descriptors than the default soft limit
+    if (!raised) {
+        struct rlimit lim;
+        if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+            lim.rlim_cur = lim.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &lim);
+        }
+        raised = 1;
+    }
+
+    double started = monotonic_ms(); // Pinning counts toward the signal phase
+    int pidfd_usable = 1; // Cleared on kernels without pidfd_open (< 5.3) or once descriptors run out
+    int reserve = open("/dev/null", O_RDONLY | O_CLOEXEC); // Freed when pidfds run out, so the checks can still read stat
+    for (int i = 0; i < batch->victims.count; i++) {
+        pid_t pid = batch->victims.pids[i];
+        int fd = -1;
+        if (pidfd_usable) {
+            fd = (int)syscall(SYS_pidfd_open, pid, 0);
+            COUNT(syscalls, 1);
+            if (fd == -1 && errno == ESRCH) {
+                batch->pidfds[i] = SIGNAL_SKIP_GONE; // Exited since the scan
+                continue;
+            }
+            if (fd == -1 && (errno == ENOSYS || errno == EMFILE || errno == ENFILE)) { // Fall back to kill()
+                pidfd_usable = 0;
+                if (reserve != -1) close(reserve);
+                reserve = -1;
+            }
+        }
+        // The pidfd now pins whatever owns this PID; make sure that is the snapshot's process. Without a
+        // pidfd, kill() gets the same checks, though the PID can still be recycled before delivery
+        int keep = fd == -1 ? SIGNAL_VIA_KILL : fd;
+        int verdict = signal_verdict(table, pid, keep);
+        if (verdict == SIGNAL_SKIP_UNCHECKED && reserve != -1) { // The pidfd took the last descriptor
+            close(reserve);
+            reserve = -1;
+            verdict = signal_verdict(table, pid, keep);
+        }
+        if (verdict == SIGNAL_SKIP_UNCHECKED && fd != -1) { // Still none: give this pidfd back, use kill()
+            close(fd);
+            fd = -1;
+            keep = SIGNAL_VIA_KILL;
+            pidfd_usable = 0;
+            verdict = signal_verdict(table, pid, keep);
+        }
+        if (fd != -1 && verdict != fd) close(fd);
+        batch->pidfds[i] = verdict;
+    }
+    if (reserve != -1) close(reserve);
+    phase_ms[PHASE_SIGNAL] += monotonic_ms() - started;
+    return 0;
+}
+
+// Send sig to victim i; returns 0, or -1 with errno set (ESRCH for victims skipped while pinning)
+int signal_batch_send(const SignalBatch *batch, int i, int sig) {
+    int fd = batch->pidfds[i];
+    if (fd >= 0 || fd == SIGNAL_VIA_KILL) COUNT(syscalls, 1);
+    if (fd >= 0) return (int)syscall(SYS_pidfd_send_signal, fd, sig, NULL, 0); // Race-free delivery
+    if (fd == SIGNAL_VIA_KILL) return kill(batch->victims.pids[i], sig);        // No pidfd available
+    errno = ESRCH;                                                              // Gone, recycled or moved
+    return -1;
+}
+
+// Close pidfds and release the victim list
+void signal_batch_free(SignalBatch *batch) {
+    for (int i = 0; batch->pidfds && i < batch->victims.count; i++) {
+        if (batch->pidfds[i] >= 0) close(batch->pidfds[i]);
+    }
+    free(batch->pidfds);
+    batch->pidfds = NULL;
+    pid_arena_free(&batch->victims);
+}
+
+// Read the cgroup v2 path of pid ("0::/path" in /proc/[pid]/cgroup); -1 if unavailable
+static int cgroup_of(pid_t pid, char *path, size_t size) {
+    char file[64];
+    snprintf(file, sizeof(file), "/proc/%d/cgroup", pid);
+    FILE *fp = fopen(file, "r");
+    if (!fp) return -1;
+    char line[4096];
+    int found = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "0::", 3) != 0) continue; // Only the unified hierarchy
+        line[strcspn(line, "\n")] = '\0';
+        if (strlen(line + 3) < size) {
+            strcpy(path, line + 3);
+            found = 0;
+        }
+        break;
+    }
+    fclose(fp);
+    return found;
+}
+
+// Is path equal to dir or inside it?
+static int cgroup_within(const char *path, const char *dir) {
+    size_t len = strlen(dir);
+    if (strcmp(dir, "/") == 0) return 1; // Root contains everything
+    return strncmp(path, dir, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+// Check every process in dir and its child cgroups is a victim; returns 1 if so, 0 if not
+static int cgroup_only_victims(const char *dir, const ProcessTable *table, pid_t target) {
+    char file[4352];
+    snprintf(file, sizeof(file), "%s/cgroup.procs", dir);
+    FILE *fp = fopen(file, "r");
+    if (!fp) return 0;
+    int pid, ok = 1;
+    while (ok && fscanf(fp, "%d", &pid) == 1) {
+        if (pid == target) ok = 0;                                // target must survive
+        else if (snapshot_find(table, pid)) ok = is_in_tree(table, target, pid); // Known: must descend from target
+        else ok = is_in_tree(table, target, get_process_info(pid).ppid); // Forked after the scan: parent must be ours
+    }
+    fclose(fp);
+
+    DIR *d = ok ? opendir(dir) : NULL; // Child cgroups are killed/frozen along with dir
+    struct dirent *entry;
+    while (d && ok && (entry = readdir(d)) != NULL) {
+        if (entry->d_type != DT_DIR || entry->d_name[0] == '.') continue;
+        snprintf(file, sizeof(file), "%s/%s", dir, entry->d_name);
+        ok = cgroup_only_victims(file, table, target);
+    }
+    if (d) closedir(d);
+    return ok;
+}
+
+// Find a cgroup v2 directory holding exactly target's descendants; 1 and dir filled on success
+int cgroup_match_subtree(const ProcessTable *table, pid_t target, const PidArena *victims, char *dir, size_t size) {
+    if (victims->count == 0) return 0;
+
+    char mount[256] = "";                    // Where the unified hierarchy is mounted
+    FILE *mounts = fopen("/proc/self/mounts", "r");
+    if (!mounts) return 0;
+    char src[256], where[256], type[64];
+    while (fscanf(mounts, "%255s %255s %63s %*[^\n]", src, where, type) == 3) {
+        if (strcmp(type, "cgroup2") == 0) {
+            strcpy(mount, where);
+            break;
+        }
+    }
+    fclose(mounts);
+    if (!mount[0]) return 0;                 // cgroup v1 only, or not mounted
+
+    char top[4096] = "", path[4096];         // Shallowest cgroup among the victims
+    for (int i = 0; i < victims->count; i++) {
+        if (cgroup_of(victims->pids[i], path, sizeof(path)) == -1) continue; // Already exited
+        if (!top[0] || strlen(path) < strlen(top)) strcpy(top, path);
+    }
+    if (!top[0] || strcmp(top, "/") == 0) return 0; // Never kill or freeze the whole host
+    for (int i = 0; i < victims->count; i++) {
+        if (cgroup_of(victims->pids[i], path, sizeof(path)) == 0 && !cgroup_within(path, top)) return 0; // Spread out
+    }
+    if (cgroup_of(target, path, sizeof(path)) == 0 && cgroup_within(path, top)) return 0; // Would hit target
+    if (cgroup_of(getpid(), path, sizeof(path)) == 0 && cgroup_within(path, top)) return 0; // Would hit this process
+
+    if ((size_t)snprintf(dir, size, "%s%s", mount, top) >= size) return 0;
+    return cgroup_only_victims(dir, table, target); // Exact match only
+}
+
+// Write value to dir/file (cgroup.kill, cgroup.freeze); 0 on success
+int cgroup_write(const char *dir, const char *file, const char *value) {
+    char path[4352];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    double started = monotonic_ms();
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    COUNT(syscalls, 1);
+    if (fd == -1) return -1; // cgroup.kill needs Linux 5.14, cgroup.freeze 5.2
+    ssize_t n = write(fd, value, strlen(value));
+    int saved = errno;
+    close(fd);
+    COUNT(syscalls, 2);
+    phase_ms[PHASE_SIGNAL] += monotonic_ms() - started;
+    errno = saved;
+    return n == (ssize_t)strlen(value) ? 0 : -1;
+}
+
+// ---------------------------------------------------------------------------
+// io_uring backend (--uring): each stat file is one linked chain of openat
+// into a fixed-file slot, read from that slot, and close of the slot, and
+// URING_BATCH chains go to the kernel in a single io_uring_enter(). A full
+// scan then costs a couple of syscalls per batch instead of three per PID.
+// Direct descriptors need Linux 5.15; when the ring cannot be set up or the
+// kernel rejects the chain, the chunk is read synchronously instead.
+// ---------------------------------------------------------------------------
+
+typedef struct {
+    int fd;                          // Ring descriptor
+    unsigned *sq_tail, *sq_mask, *sq_array; // Submission ring, shared with the kernel
+    unsigned *cq_head, *cq_tail, *cq_mask;  // Completion ring
+    struct io_uring_cqe *cqes;
+    struct io_uring_sqe *sqes;       // Submission entries, indexed by sq_array
+    void *ring_map, *sqe_map;        // Mappings to release
+    size_t ring_size, sqe_size;
+} StatRing;
+
+static int uring_warned = 0; // Fallback warning is printed once per run
+
+// Say once why --uring is not in effect
+static void uring_fallback(const char *why, int errnum) {
+    if (__atomic_exchange_n(&uring_warned, 1, __ATOMIC_RELAXED)) return;
+    fprintf(stderr, "Warning: --uring unavailable (%s: %s); reading stat files synchronously\n", why, strerror(errnum));
+}
+
+// Create a ring sized for one batch and register URING_BATCH empty fixed-file slots; -1 on failure
+static int stat_ring_open(StatRing *ring) {
+    memset(ring, 0, sizeof(*ring));
+    struct io_uring_params params = {0};
+    ring->fd = (int)syscall(SYS_io_uring_setup, 4 * URING_BATCH, &params); // Power of two above 3 per chain
+    COUNT(syscalls, 1);
+    if (ring->fd == -1) {
+        uring_fallback("io_uring_setup", errno); // Old kernel, seccomp or kernel.io_uring_disabled
+        return -1;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) { // 5.4+; older kernels lack direct descriptors anyway
+        uring_fallback("io_uring features", ENOSYS);
+        close(ring->fd);
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->sqe_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->ring_map = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->sqe_map = mmap(NULL, ring->sqe_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    int fds[URING_BATCH]; // -1 leaves a slot empty for openat to fill
+    memset(fds, -1, sizeof(fds));
+    if (ring->ring_map == MAP_FAILED || ring->sqe_map == MAP_FAILED ||
+        syscall(SYS_io_uring_register, ring->fd, IORING_REGISTER_FILES, fds, URING_BATCH) == -1) {
+        uring_fallback("io_uring ring setup", errno);
+        if (ring->ring_map != MAP_FAILED) munmap(ring->ring_map, ring->ring_size);
+        if (ring->sqe_map != MAP_FAILED) munmap(ring->sqe_map, ring->sqe_size);
+        close(ring->fd);
+        return -1;
+    }
+    COUNT(syscalls, 1);
+
+    char *base = ring->ring_map; // Single mapping covers both rings
+    ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(base + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(base + params.sq_off.array);
+    ring->cq_head = (unsigned *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+    ring->sqes = ring->sqe_map;
+    return 0;
+}
+
+static void stat_ring_close(StatRing *ring) {
+    munmap(ring->sqe_map, ring->sqe_size);
+    munmap(ring->ring_map, ring->ring_size);
+    close(ring->fd); // Also drops the fixed-file table
+    COUNT(syscalls, 1);
+}
+
+// Queue submission entry i (entries are reused from 0 for every batch); returns it zeroed
+static struct io_uring_sqe *stat_ring_sqe(StatRing *ring, unsigned i) {
+    unsigned tail = *ring->sq_tail + i; // Published all at once by stat_ring_submit()
+    ring->sq_array[tail & *ring->sq_mask] = i;
+    memset(&ring->sqes[i], 0, sizeof(ring->sqes[i]));
+    return &ring->sqes[i];
+}
+
+// Publish n queued entries, wait until all n completions are in, and hand each to the caller's
+// results array as res[user_data]; -1 if io_uring_enter fails
+static int stat_ring_submit(StatRing *ring, unsigned n, int *res) {
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + n, __ATOMIC_RELEASE);
+    unsigned submitted = 0, completed = 0;
+    while (completed < n) {
+        int rc = (int)syscall(SYS_io_uring_enter, ring->fd, n - submitted, n - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+        COUNT(syscalls, 1);
+        if (rc == -1 && errno != EINTR) return -1;
+        if (rc > 0) submitted += (unsigned)rc;
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++, completed++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            res[cqe->user_data] = cqe->res;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// Read and parse every stat file of chunk through one ring, URING_BATCH files per submission, keeping
+// the chunk's PID order; returns -1 (chunk untouched) when the synchronous loop should run instead
+static int uring_parse_chunk(ParseChunk *chunk) {
+    StatRing ring;
+    if (stat_ring_open(&ring) == -1) return -1;
+    char (*bufs)[1024] = malloc(URING_BATCH * sizeof(*bufs)); // One stat line per chain
+    if (!bufs) {
+        stat_ring_close(&ring);
+        return -1;
+    }
+
+    char paths[URING_BATCH][32];
+    int res[3 * URING_BATCH]; // Completion results, indexed by 3 * chain + step
+    int status = 0;
+    chunk->parsed = 0;
+    for (int begin = 0; begin < chunk->n; begin += URING_BATCH) {
+        int batch = chunk->n - begin < URING_BATCH ? chunk->n - begin : URING_BATCH;
+        for (int k = 0; k < batch; k++) {
+            snprintf(paths[k], sizeof(paths[k]), "/proc/%d/stat", chunk->pids[begin + k]);
+            struct io_uring_sqe *sqe = stat_ring_sqe(&ring, 3 * k); // openat into fixed slot k
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long)paths[k];
+            sqe->open_flags = O_RDONLY;
+            sqe->file_index = k + 1;     // 1-based: 0 would mean a regular descriptor
+            sqe->flags = IOSQE_IO_LINK;  // The read waits for the open, and is cancelled if it fails
+            sqe->user_data = 3 * k;
+
+            sqe = stat_ring_sqe(&ring, 3 * k + 1); // read from slot k
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = k;
+            sqe->addr = (unsigned long)bufs[k];
+            sqe->len = sizeof(bufs[k]) - 1;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK; // Close even if the read fails
+            sqe->user_data = 3 * k + 1;
+
+            sqe = stat_ring_sqe(&ring, 3 * k + 2); // close slot k
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = k + 1;
+            sqe->user_data = 3 * k + 2;
+        }
+        if (stat_ring_submit(&ring, 3 * (unsigned)batch, res) == -1) {
+            uring_fallback("io_uring_enter", errno);
+            status = -1;
+            break;
+        }
+        if (begin == 0 && (res[0] == -EINVAL || res[0] == -EOPNOTSUPP || res[0] == -EBADF)) {
+            uring_fallback("io_uring direct open", -res[0]); // Kernel without direct descriptors
+            status = -1;
+            break;
+        }
+
+        for (int k = 0; k < batch; k++) { // Parse in PID order so slots match the synchronous scan
+            if (res[3 * k + 1] <= 0) continue; // Vanished between listing and open, or unreadable
+            COUNT(stat_reads, 1);
+            ProcessExt *ext = chunk->ext ? &chunk->ext[chunk->parsed] : NULL;
+            ProcessInfo info;
+            if (parse_stat_line(bufs[k], (size_t)res[3 * k + 1], &info) == -1) continue;
+            if (ext && parse_stat_ext(bufs[k], (size_t)res[3 * k + 1], ext) == 0) ext->loaded = 1;
+            chunk->out[chunk->parsed++] = info;
+        }
+    }
+    free(bufs);
+    stat_ring_close(&ring);
+    return status; // On failure the synchronous loop starts the chunk over
+}
+
+// ---------------------------------------------------------------------------
+// Output layer: handlers append to one buffer that reaches stdout with a single
+// write when the answer is complete. --format=text keeps the classic lines;
+// jsonl and bin emit the same answers as typed records. A binary record is
+//   u32 length (bytes after this field), u16 kind, u16 nvalues,
+//   i64 values[nvalues], then the kind's string without a terminator,
+// all in host byte order, so collectors can skip kinds they do not know.
+// ---------------------------------------------------------------------------
+
+static const OutKind out_kinds[OUT_KIND_COUNT] = {
+    [OUT_QUERY]          = {"query", {NULL}, "line"},
+    [OUT_NOT_IN_TREE]    = {"not_in_tree", {"pid", "root", NULL}, NULL},
+    [OUT_PROCESS]        = {"process", {"pid", "ppid", NULL}, NULL},
+    [OUT_PID]            = {"pid", {"pid", NULL}, NULL},
+    [OUT_DEFUNCT_COUNT]  = {"defunct_count", {"pid", "count", NULL}, NULL},
+    [OUT_STATUS]         = {"status", {"pid", "defunct", NULL}, NULL},
+    [OUT_SUBTREE]        = {"subtree", {"pid", "procs", "defunct", "threads", "rss_kib", "utime_ms", "stime_ms", NULL}, "comm"},
+    [OUT_CHILD_SUBTREE]  = {"child_subtree", {"pid", "procs", "defunct", "threads", "rss_kib", "utime_ms", "stime_ms", NULL}, "comm"},
+    [OUT_SIGNALLED]      = {"signalled", {"pid", "signal", NULL}, NULL},
+    [OUT_PARENT_KILLED]  = {"parent_killed", {"pid", "zombie", NULL}, NULL},
+    [OUT_NO_ZOMBIES]     = {"no_zombies", {"pid", NULL}, NULL},
+    [OUT_CGROUP]         = {"cgroup", {"count", "value", NULL}, "file"},
+    [OUT_WATCH_START]    = {"watch_start", {"pid", "descendants", "interval_ms", NULL}, NULL},
+    [OUT_NEW]            = {"new", {"elapsed_ms", "pid", "ppid", NULL}, "comm"},
+    [OUT_NEW_DEFUNCT]    = {"new_defunct", {"elapsed_ms", "pid", "ppid", NULL}, "comm"},
+    [OUT_BECAME_DEFUNCT] = {"became_defunct", {"elapsed_ms", "pid", "ppid", NULL}, "comm"},
+    [OUT_EXITED]         = {"exited", {"elapsed_ms", "pid", "ppid", NULL}, "comm"},
+    [OUT_WATCH_END]      = {"watch_end", {"pid", NULL}, NULL},
+    [OUT_SIGNAL_OUTCOME] = {"signal_outcome", {"signal", "errno", "count", NULL}, NULL},
+    [OUT_ZOMBIE_PARENT]  = {"zombie_parent", {"pid", "zombies", "killed", NULL}, NULL},
+    [OUT_TREE_NODE]      = {"tree_node", {"depth", "pid", "descendants", "rss_kib", "count", NULL}, "comm"},
+    [OUT_TREE_MORE]      = {"tree_more", {"depth", "hidden", "procs", NULL}, NULL},
+};
+
+static struct {
+    char *data;      // Encoded answers not yet written
+    size_t len;      // Bytes used
+    size_t capacity; // Bytes allocated
+} out_buffer;
+
+// Room for n more bytes at the end of the buffer; NULL (after writing out what fits) if memory runs out
+static char *out_reserve(size_t n) {
+    if (out_buffer.len + n > out_buffer.capacity) {
+        size_t capacity = out_buffer.capacity ? out_buffer.capacity : 65536;
+        while (capacity < out_buffer.len + n) capacity *= 2;
+        char *grown = realloc(out_buffer.data, capacity);
+        if (!grown) {
+            out_flush(); // Keep what we have, then retry in the space already allocated
+            return n <= out_buffer.capacity ? out_buffer.data : NULL;
+        }
+        out_buffer.data = grown;
+        out_buffer.capacity = capacity;
+    }
+    return out_buffer.data + out_buffer.len;
+}
+
+// Account for n bytes written at out_reserve()'s pointer
+static void out_commit(size_t n) {
+    out_buffer.len += n;
+    if (out_buffer.len >= OUT_BUFFER_LIMIT) out_flush(); // Bound memory on very large answers
+}
+
+// Write everything buffered to stdout
+void out_flush(void) {
+    size_t done = 0;
+    while (done < out_buffer.len) {
+        ssize_t n = write(STDOUT_FILENO, out_buffer.data + done, out_buffer.len - done);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (errno != EPIPE) print_error("Cannot write output", errno); // A closed reader is not worth a message
+            break;
+        }
+        done += (size_t)n;
+    }
+    out_buffer.len = 0; // Unwritable output is dropped, not retried
+}
+
+// Append a printf-formatted line in text mode; structured formats carry the same data in out_record()
+void out_text(const char *fmt, ...) {
+    if (run_options.format != FORMAT_TEXT) return;
+    va_list args, again;
+    va_start(args, fmt);
+    va_copy(again, args);
+    char *p = out_reserve(256); // Enough for every line we print but the longest comm/path ones
+    int n = p ? vsnprintf(p, 256, fmt, args) : -1;
+    if (n >= 256 && (p = out_reserve((size_t)n + 1))) vsnprintf(p, (size_t)n + 1, fmt, again);
+    if (n > 0 && p) out_commit((size_t)n);
+    va_end(again);
+    va_end(args);
+}
+
+// Append text as a JSON string body, escaping quotes, backslashes and control bytes
+static void out_json_string(const char *text) {
+    size_t len = strlen(text);
+    char *p = out_reserve(len * 6 + 1); // Worst case: every byte becomes \u00XX, plus sprintf's NUL
+    if (!p) return;
+    char *q = p;
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            *q++ = '\\';
+            *q++ = (char)*c;
+        } else if (*c < 0x20) {
+            q += sprintf(q, "\\u%04x", *c);
+        } else {
+            *q++ = (char)*c;
+        }
+    }
+    out_commit((size_t)(q - p));
+}
+
+// Append one record of kind in the structured formats; values follow the kind's field order
+void out_record(int kind, const long long *values, const char *text) {
+    const OutKind *k = &out_kinds[kind];
+    int nvalues = 0;
+    while (k->fields[nvalues]) nvalues++;
+    if (!k->text) text = NULL;
+
+    if (run_options.format == FORMAT_JSONL) {
+        char *p = out_reserve(32 + strlen(k->name) + (size_t)nvalues * 48);
+        if (!p) return;
+        int n = sprintf(p, "{\"type\":\"%s\"", k->name);
+        for (int i = 0; i < nvalues; i++) n += sprintf(p + n, ",\"%s\":%lld", k->fields[i], values[i]);
+        out_commit((size_t)n);
+        if (text) {
+            if (!(p = out_reserve(8 + strlen(k->text)))) return;
+            out_commit((size_t)sprintf(p, ",\"%s\":\"", k->text));
+            out_json_string(text);
+            if ((p = out_reserve(1))) { *p = '"'; out_commit(1); }
+        }
+        if ((p = out_reserve(2))) { memcpy(p, "}\n", 2); out_commit(2); }
+    } else if (run_options.format == FORMAT_BIN) {
+        size_t text_len = text ? strlen(text) : 0;
+        uint32_t length = (uint32_t)(4 + 8 * (size_t)nvalues + text_len); // Everything after the length field
+        char *p = out_reserve(4 + (size_t)length);
+        if (!p) return;
+        uint16_t head[2] = {(uint16_t)kind, (uint16_t)nvalues};
+        memcpy(p, &length, 4);
+        memcpy(p + 4, head, 4);
+        for (int i = 0; i < nvalues; i++) {
+            int64_t v = values[i];
+            memcpy(p + 8 + 8 * i, &v, 8);
+        }
+        if (text_len) memcpy(p + 8 + 8 * nvalues, text, text_len);
+        out_commit(4 + (size_t)length);
+    }
+}
+
+// Record a --cgroup fast path: count processes handled by writing value to dir/file
+static void out_cgroup(int count, int value, const char *dir, const char *file) {
+    char path[4200];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    out_record(OUT_CGROUP, (long long[]){count, value}, path);
+}
+
+// Append one PID of a listing: a bare decimal line in text mode, an OUT_PID record otherwise
+void out_pid(pid_t pid) {
+    if (run_options.format != FORMAT_TEXT) {
+        out_record(OUT_PID, (long long[]){pid}, NULL);
+        return;
+    }
+    char *p = out_reserve(12); // Ten digits, newline, spare
+    if (!p) return;
+    char digits[10];
+    int n = 0;
+    unsigned int value = (unsigned int)pid;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    for (int i = 0; i < n; i++) p[i] = digits[n - 1 - i];
+    p[n] = '\n';
+    out_commit((size_t)n + 1);
+}
+
+// ---------------------------------------------------------------------------
+// Watch mode: -w MS rescans every MS milliseconds and prints what changed under
+// the target. Each tick lists /proc, but only re-reads PIDs that are new or were
+// in the watched subtree; records outside it are copied from the previous tick.
+// A process outside the subtree can only move into it by being forked there, and
+// a fork that reuses a copied PID shows up in its parent's children file, so the
+// per-tick cost follows churn and subtree size, not host size.
+// ---------------------------------------------------------------------------
+
+static volatile sig_atomic_t watch_stop = 0; // Set by SIGINT/SIGTERM
+
+// Ask the watch loop to finish after the current tick
+static void watch_on_signal(int sig) {
+    (void)sig;
+    watch_stop = 1;
+}
+
+// A copied PID may have been recycled by a fork under a re-read process, which the listing cannot
+// tell apart. Walk the children files of every re-read record and re-read any copied child, level
+// by level; without the files (CONFIG_PROC_CHILDREN), re-read every copied record instead.
+static void refresh_reused(ProcessTable *next, unsigned char *copied) {
+    COUNT(syscalls, 1);
+    int walk = access("/proc/thread-self/children", R_OK) == 0;
+    int *index = walk ? calloc((size_t)next->max_pid + 1, sizeof(int)) : NULL; // PID -> record + 1
+    int *queue = walk ? malloc(((size_t)next->count + 1) * sizeof(int)) : NULL; // Records to expand
+    if (walk && (!index || !queue)) walk = 0; // Out of memory: fall back to reading everything
+    int head = 0, tail = 0;
+    for (int i = 0; i < next->count; i++) {
+        if (!walk) {
+            if (copied[i]) next->procs[i] = get_process_record(next->procs[i].pid, &next->ext[i]);
+            continue;
+        }
+        index[next->procs[i].pid] = i + 1;
+        if (!copied[i]) queue[tail++] = i;
+    }
+
+    PidArena kids = {0};
+    while (head < tail) {
+        int i = queue[head++];
+        if (next->procs[i].state == 'Z') continue; // An exited process keeps no children
+        if (read_children(next->procs[i].pid, next->ext[i].num_threads, &kids) == -1) continue; // Exited since
+        for (int k = 0; k < kids.count; k++) {
+            pid_t child = kids.pids[k];
+            int c = child <= next->max_pid ? index[child] - 1 : -1; // Not listed: forked after the listing
+            if (c < 0 || !copied[c]) continue;
+            copied[c] = 0;
+            next->procs[c] = get_process_record(child, &next->ext[c]); // Forked here under a recycled PID
+            if (next->procs[c].pid) queue[tail++] = c;                 // Its own children may be reused too
+        }
+    }
+    pid_arena_free(&kids);
+    free(index);
+    free(queue);
+
+    int kept = 0; // Drop records that vanished when re-read
+    for (int i = 0; i < next->count; i++) {
+        if (next->procs[i].pid == 0) continue;
+        next->procs[kept] = next->procs[i];
+        next->ext[kept++] = next->ext[i];
+    }
+    next->count = kept;
+}
+
+// Build next from a fresh /proc listing; prev must carry extended fields (starttime identifies reuse)
+int snapshot_refresh(ProcessTable *next, const ProcessTable *prev, pid_t pid) {
+    memset(next, 0, sizeof(*next));
+    pid_t *pids;
+    double phase_start = monotonic_ms();
+    int npids = enumerate_pids(&pids);
+    phase_ms[PHASE_ENUMERATE] += monotonic_ms() - phase_start;
+    if (npids == -1) return -1; // enumerate_pids already reported the failure
+
+    phase_start = monotonic_ms();
+    next->procs = malloc(((size_t)npids + 1) * sizeof(ProcessInfo));
+    next->ext = calloc((size_t)npids + 1, sizeof(ProcessExt));
+    if (!next->procs || !next->ext) {
+        print_error("Cannot allocate process table", errno); // Out of memory
+        free(pids);
+        snapshot_free(next);
+        return -1;
+    }
+    next->capacity = npids;
+    next->ext_complete = 1;
+    unsigned char *copied = calloc((size_t)npids + 1, 1); // Per record: taken from prev without a read
+    if (!copied) {
+        print_error("Cannot allocate process table", errno);
+        free(pids);
+        snapshot_free(next);
+        return -1;
+    }
+
+    for (int i = 0; i < npids; i++) {
+        int old = snapshot_slot(prev, pids[i]);
+        ProcessInfo *info = &next->procs[next->count];
+        ProcessExt *ext = &next->ext[next->count];
+        if (old >= 0 && !is_in_tree(prev, pid, pids[i])) {
+            *info = prev->procs[old]; // Unwatched and already known: reuse unless the PID was reused
+            *ext = prev->ext[old];
+            copied[next->count] = 1;
+        } else {
+            *info = get_process_record(pids[i], ext); // New, or watched: read it again
+            if (info->pid == 0) continue;             // Vanished since the listing
+        }
+        if (info->pid > next->max_pid) next->max_pid = info->pid;
+        next->count++;
+    }
+    free(pids);
+    refresh_reused(next, copied);
+    free(copied);
+    phase_ms[PHASE_PARSE] += monotonic_ms() - phase_start;
+
+    phase_start = monotonic_ms();
+    int status = snapshot_index(next);
+    phase_ms[PHASE_INDEX] += monotonic_ms() - phase_start;
+    return status;
+}
+
+// Is q in a's subtree of pid, and the same process (same start time) in table b's subtree too?
+static int watch_same(const ProcessTable *a, const ProcessTable *b, pid_t pid, pid_t q) {
+    int sa = snapshot_slot(a, q), sb = snapshot_slot(b, q);
+    return sa >= 0 && sb >= 0 && is_in_tree(b, pid, q) && a->ext[sa].starttime == b->ext[sb].starttime;
+}
+
+// Print a tick's changes under pid; returns how many lines were printed
+static int watch_report(const ProcessTable *prev, const ProcessTable *next, pid_t pid, double elapsed_ms) {
+    int changes = 0;
+    int n, first = snapshot_range(next, pid, &n);
+    for (int row = first + 1; row < first + n; row++) { // New descendants and new zombies
+        pid_t q = next->dfs_pid[row];
+        int slot = next->dfs_slot[row];
+        const char *tag = NULL;
+        int kind = OUT_NEW;
+        if (!watch_same(next, prev, pid, q)) {
+            kind = next->dfs_state[row] == 'Z' ? OUT_NEW_DEFUNCT : OUT_NEW;
+            tag = kind == OUT_NEW_DEFUNCT ? "new defunct descendant" : "new descendant";
+        } else if (next->dfs_state[row] == 'Z' && prev->procs[snapshot_slot(prev, q)].state != 'Z') {
+            kind = OUT_BECAME_DEFUNCT;
+            tag = "became defunct";
+        }
+        if (!tag) continue;
+        if (changes++ == 0) out_text("[%.1f s]\n", elapsed_ms / 1000);
+        out_text("+ %d %s (parent %d, %s)\n", q, tag, next->dfs_ppid[row], next->ext[slot].comm);
+        out_record(kind, (long long[]){(long long)elapsed_ms, q, next->dfs_ppid[row]}, next->ext[slot].comm);
+    }
+    first = snapshot_range(prev, pid, &n);
+    for (int row = first + 1; row < first + n; row++) { // Descendants that are gone
+        pid_t q = prev->dfs_pid[row];
+        if (watch_same(prev, next, pid, q)) continue;
+        const char *comm = prev->ext[prev->dfs_slot[row]].comm;
+        if (changes++ == 0) out_text("[%.1f s]\n", elapsed_ms / 1000);
+        out_text("- %d exited (parent %d, %s)\n", q, prev->dfs_ppid[row], comm);
+        out_record(OUT_EXITED, (long long[]){(long long)elapsed_ms, q, prev->dfs_ppid[row]}, comm);
+    }
+    out_flush(); // One block per tick, visible immediately
+    return changes;
+}
+
+// -w MS: print new descendants, new zombies and exits under the target every MS milliseconds
+int run_watch(const Query *query) {
+    pid_t pid = query->target_pid;
+    ProcessTable prev;
+    if (snapshot_build(&prev, SNAPSHOT_EXTENDED) == -1) return 1; // Starting point; start times included
+    if (!snapshot_find(&prev, query->root_pid)) {
+        fprintf(stderr, "Error: Root process %d does not exist or is inaccessible\n", query->root_pid);
+        snapshot_free(&prev);
+        return 1;
+    }
+    if (!is_in_tree(&prev, query->root_pid, pid)) {
+        out_text("Notice: Process %d does not belong to the tree rooted at %d\n", pid, query->root_pid);
+        out_record(OUT_NOT_IN_TREE, (long long[]){pid, query->root_pid}, NULL);
+        snapshot_free(&prev);
+        return 0;
+    }
+
+    struct sigaction sa = {0}; // No SA_RESTART: a signal cuts the sleep short
+    sa.sa_handler = watch_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int n;
+    snapshot_range(&prev, pid, &n);
+    out_text("Watching %d descendants of %d every %d ms\n", n - 1, pid, query->value);
+    out_record(OUT_WATCH_START, (long long[]){pid, n - 1, query->value}, NULL);
+    out_flush();
+    double started = monotonic_ms();
+    unsigned long long target_start = prev.ext[snapshot_slot(&prev, pid)].starttime;
+    int status = 0;
+    while (!watch_stop) {
+        struct timespec pause_for = {query->value / 1000, (query->value % 1000) * 1000000L};
+        nanosleep(&pause_for, NULL);
+        if (watch_stop) break;
+
+        ProcessTable next;
+        if (snapshot_refresh(&next, &prev, pid) == -1) {
+            status = 1;
+            break;
+        }
+        watch_report(&prev, &next, pid, monotonic_ms() - started);
+        snapshot_free(&prev);
+        prev = next; // Next tick diffs against this one
+
+        int slot = snapshot_slot(&prev, pid);
+        if (slot < 0 || prev.ext[slot].starttime != target_start) {
+            out_text("Process %d exited; watch ended\n", pid); // Nothing left to watch
+            out_record(OUT_WATCH_END, (long long[]){pid}, NULL);
+            out_flush();
+            break;
+        }
+    }
+    snapshot_free(&prev);
+    return status;
+}
+
+// ---------------------------------------------------------------------------
+// Daemon mode: keep one table current from kernel proc connector events and
+// answer queries over a Unix socket without rescanning /proc.
+// ---------------------------------------------------------------------------
+
+// Live-table bookkeeping shared by the event handlers
+typedef struct {
+    ProcessTable table;   // Records plus a PID index widened to pid_max
+    pid_t *exited;        // Zombies to re-read before each query until their parent reaps them
+    int exited_count;     // Entries in exited
+    int exited_capacity;  // Allocated length of exited
+    int orphans_dirty;    // An exit since the last query may have reparented children
+    int children_dirty;   // Children index no longer matches the records
+} LiveTable;
+
+static volatile sig_atomic_t daemon_stop = 0; // Set by SIGINT/SIGTERM
+
+// Ask the event loop to finish
+static void daemon_on_signal(int sig) {
+    (void)sig;
+    daemon_stop = 1;
+}
+
+// Queue a zombie for re-reading; reaping sends no event, so it is the only way to see it go
+static void live_track(LiveTable *live, pid_t pid) {
+    if (live->exited_count == live->exited_capacity) {
+        int new_capacity = live->exited_capacity ? live->exited_capacity * 2 : 256;
+        pid_t *grown = realloc(live->exited, new_capacity * sizeof(pid_t));
+        if (!grown) return;                         // Settled by the next resync instead
+        live->exited = grown;
+        live->exited_capacity = new_capacity;
+    }
+    live->exited[live->exited_count++] = pid;
+}
+
+// Build a fresh snapshot and widen its PID index so any future PID can be stored in O(1)
+static int live_load(LiveTable *live) {
+    if (snapshot_build(&live->table, SNAPSHOT_BASIC) == -1) return -1; // Full /proc scan, done once per (re)sync
+
+    long pid_max = 4194304;                            // Kernel upper bound when the sysctl is unreadable
+    int fd = open("/proc/sys/kernel/pid_max", O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        char buf[32];
+        ssize_t len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len > 0) {
+            buf[len] = '\0';
+            pid_max = strtol(buf, NULL, 10);
+        }
+    }
+    if (pid_max < live->table.max_pid) pid_max = live->table.max_pid;
+
+    int *wide = realloc(live->table.slot_of, ((size_t)pid_max + 1) * sizeof(int));
+    if (!wide) {
+        print_error("Cannot allocate live PID index", errno); // Out of memory
+        snapshot_free(&live->table);
+        return -1;
+    }
+    memset(wide + live->table.max_pid + 1, 0, ((size_t)pid_max - live->table.max_pid) * sizeof(int)); // Clear new range
+    live->table.slot_of = wide;
+    live->table.max_pid = (pid_t)pid_max;
+    live->exited_count = 0;
+    for (int i = 0; i < live->table.count; i++) { // Zombies already present exited before we subscribed
+        if (live->table.procs[i].state == 'Z') live_track(live, live->table.procs[i].pid);
+    }
+    live->orphans_dirty = 0;
+    live->children_dirty = 0;
+    return 0;
+}
+
+// Insert or overwrite one record in the live table
+static int live_put(LiveTable *live, ProcessInfo info) {
+    ProcessTable *t = &live->table;
+    if (info.pid <= 0 || info.pid > t->max_pid) return -1; // Cannot be indexed
+    int slot = snapshot_slot(t, info.pid);
+    if (slot < 0) {                                        // New PID: append
+        if (t->count == t->capacity) {
+            int new_capacity = t->capacity ? t->capacity * 2 : 1024;
+            ProcessInfo *grown = realloc(t->procs, ((size_t)new_capacity + 1) * sizeof(ProcessInfo));
+            if (!grown) return -1;
+            t->procs = grown;
+            t->capacity = new_capacity;
+        }
+        slot = t->count++;
+        t->slot_of[info.pid] = slot + 1;
+    }
+    t->procs[slot] = info;     // Store the latest view of the process
+    live->children_dirty = 1;  // Parent links may have changed
+    return 0;
+}
+
+// Remove one record by moving the last record into its slot
+static void live_remove(LiveTable *live, pid_t pid) {
+    ProcessTable *t = &live->table;
+    int slot = snapshot_slot(t, pid);
+    if (slot < 0) return;                         // Already gone
+    int last = --t->count;                        // Slot being vacated at the end
+    if (slot != last) {
+        t->procs[slot] = t->procs[last];          // Fill the hole
+        t->slot_of[t->procs[slot].pid] = slot + 1;
+    }
+    t->slot_of[pid] = 0;                          // Forget removed PID
+    live->children_dirty = 1;
+}
+
+// Apply one proc connector event in O(1)
+static void live_apply_event(LiveTable *live, const struct proc_event *ev) {
+    switch (ev->what) {
+    case PROC_EVENT_FORK:
+        if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid) break; // New thread, not a process
+        live_put(live, (ProcessInfo){ev->event_data.fork.child_tgid, ev->event_data.fork.parent_tgid, 'R', 0});
+        break;
+    case PROC_EVENT_EXIT: {
+        if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid) break; // Thread exit
+        pid_t pid = ev->event_data.exit.process_tgid;
+        int slot = snapshot_slot(&live->table, pid);
+        if (slot < 0) break;
+        live->table.procs[slot].state = 'Z'; // Zombie until its parent reaps it; reaping has no event
+        live_track(live, pid);               // Revisit before every query until it is reaped
+        live->orphans_dirty = 1;
+        break;
+    }
+    default:
+        break; // EXEC, UID, SID and the rest do not change pid, ppid or state
+    }
+}
+
+// Reconcile what the connector cannot report: reaped zombies and children reparented by an exit.
+// -1 if the table was lost (a failed reindex frees it) and could not be rebuilt from /proc
+static int live_settle(LiveTable *live) {
+    ProcessTable *t = &live->table;
+    int kept = 0;
+    for (int i = 0; i < live->exited_count; i++) { // Reaped yet, or still a zombie?
+        pid_t pid = live->exited[i];
+        ProcessInfo info = get_process_info(pid);
+        if (info.pid == 0) {
+            live_remove(live, pid);
+            continue;
+        }
+        int slot = snapshot_slot(t, pid);
+        if (slot < 0 || t->procs[slot].state != info.state || t->procs[slot].ppid != info.ppid) live_put(live, info);
+        if (info.state == 'Z') live->exited[kept++] = pid; // Keep until a re-read finds nothing
+    }
+    live->exited_count = kept;
+
+    if (live->orphans_dirty) {
+        live->orphans_dirty = 0;
+        // Orphans were reparented when their parent exited; re-read just those records
+        for (int i = 0; i < t->count;) {
+            const ProcessInfo *parent = snapshot_find(t, t->procs[i].ppid);
+            if (t->procs[i].ppid != 0 && (!parent || parent->state == 'Z')) {
+                ProcessInfo info = get_process_info(t->procs[i].pid);
+                if (info.pid == 0) {
+                    live_remove(live, t->procs[i].pid); // Slot i now holds another record; revisit it
+                    continue;
+                }
+                t->procs[i] = info;
+                live->children_dirty = 1;
+            }
+            i++;
+        }
+    }
+    if (live->children_dirty) {
+        if (snapshot_index_children(t) == -1) return live_load(live); // Already reported; table freed
+        live->children_dirty = 0; // Index matches the records again
+    }
+    return 0;
+}
+
+// The connector does not report SIGSTOP/SIGCONT, so -dt re-reads the states of its subtree first
+static void live_refresh_subtree(LiveTable *live, pid_t pid) {
+    int *slots;
+    int n = snapshot_subtree(&live->table, pid, &slots);
+    for (int i = 0; i < n; i++) {
+        ProcessInfo *info = &live->table.procs[slots[i]];
+        ProcessInfo fresh = get_process_info(info->pid);
+        if (fresh.pid == info->pid) info->state = fresh.state; // Keep links; refresh state only
+    }
+    free(slots);
+}
+
+// Open a proc connector socket and subscribe to process events
+static int connector_open(void) {
+    int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (fd == -1) {
+        print_error("Cannot open proc connector socket", errno); // Kernel without CONFIG_PROC_EVENTS
+        return -1;
+    }
+    int rcvbuf = 8 * 1024 * 1024; // Absorb fork bursts between reads
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_nl addr = {0};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC; // Process events multicast group
+    addr.nl_pid = getpid();
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        print_error("Cannot bind proc connector socket", errno); // Usually missing CAP_NET_ADMIN
+        close(fd);
+        return -1;
+    }
+
+    struct __attribute__((packed)) {
+        struct nlmsghdr header;        // Netlink envelope
+        struct cn_msg msg;             // Connector envelope
+        enum proc_cn_mcast_op op;      // PROC_CN_MCAST_LISTEN
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = NLMSG_DONE;
+    request.header.nlmsg_pid = getpid();
+    request.msg.id.idx = CN_IDX_PROC;
+    request.msg.id.val = CN_VAL_PROC;
+    request.msg.len = sizeof(enum proc_cn_mcast_op);
+    request.op = PROC_CN_MCAST_LISTEN;
+    if (send(fd, &request, sizeof(request), 0) == -1) {
+        print_error("Cannot subscribe to process events", errno); // Subscription refused
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read every queued connector message; returns -1 if events were lost and a resync is needed
+static int connector_drain(int fd, LiveTable *live, int flags) {
+    char buf[16384] __attribute__((aligned(NLMSG_ALIGNTO))); // Several events per datagram
+    for (;;) {
+        ssize_t len = recv(fd, buf, sizeof(buf), flags);
+        if (len == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return 0; // Queue empty
+            if (errno == ENOBUFS) return -1;                                         // Overrun: events lost
+            print_error("Cannot read process events", errno);
+            return 0;
+        }
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (unsigned int)len); h = NLMSG_NEXT(h, len)) {
+            if (h->nlmsg_type == NLMSG_ERROR || h->nlmsg_type == NLMSG_NOOP) continue;
+            struct cn_msg *msg = NLMSG_DATA(h);
+            if (msg->id.idx != CN_IDX_PROC || msg->id.val != CN_VAL_PROC) continue;
+            live_apply_event(live, (const struct proc_event *)msg->data);
+        }
+        flags = MSG_DONTWAIT; // After the first datagram, only take what is already queued
+    }
+}
+
+// Handle one client connection: read a query line, answer it with stdout/stderr sent to the client.
+// -1 if the live table is gone and the daemon must stop
+static int daemon_serve(int client, int events_fd, LiveTable *live) {
+    struct timeval timeout = {1, 0}; // A stalled client must not block event processing for long
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char line[1024]; // "root target [option [value]]\n"
+    size_t used = 0;
+    while (used < sizeof(line) - 1) {
+        ssize_t n = read(client, line + used, sizeof(line) - 1 - used);
+        if (n <= 0) break;
+        used += (size_t)n;
+        if (memchr(line, '\n', used)) break; // Full line received
+    }
+    line[used] = '\0';
+
+    char *tokens[5]; // One spare to detect extra arguments
+    int ntokens = split_query_line(line, tokens, 5);
+
+    // Catch up with everything the kernel has reported so far, then reconcile
+    int status = 0;
+    if (connector_drain(events_fd, live, MSG_DONTWAIT) == -1) {
+        snapshot_free(&live->table); // Events were lost; start over from /proc
+        status = live_load(live);
+    }
+    if (status == 0) status = live_settle(live);
+    if (status == -1) {
+        dprintf(client, "Error: Daemon lost its process table\n"); // Never answer from an empty table
+        return -1;
+    }
+
+    out_flush();    // Nothing buffered may leak into the client's answer
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO), saved_err = dup(STDERR_FILENO);
+    dup2(client, STDOUT_FILENO); // Handlers print with printf/fprintf as usual
+    dup2(client, STDERR_FILENO);
+
+    Query query;
+    if (parse_query(ntokens, tokens, &query) == 0) {
+        if (query.option && strcmp(query.option, "-dt") == 0) live_refresh_subtree(live, query.target_pid);
+        snapshot_reset_ext(&live->table); // RSS and CPU time move on between queries
+        run_query(&live->table, &query); // Same dispatch as one-shot mode
+    }
+
+    out_flush();    // Push the answer out before restoring descriptors
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    return 0;
+}
+
+// Serve queries on socket_path until SIGINT or SIGTERM
+int run_daemon(const char *socket_path) {
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", socket_path); // sun_path limit
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    LiveTable live = {0};                  // Single owner of the long-lived table
+    int events_fd = connector_open();      // Subscribe before scanning so no fork is missed
+    if (events_fd == -1) return 1;
+    if (live_load(&live) == -1) {
+        close(events_fd);
+        return 1;
+    }
+
+    struct stat st;
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path); // Stale socket from a previous run
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(listen_fd, 64) == -1) {
+        print_error("Cannot listen on daemon socket", errno); // Path in use or not writable
+        if (listen_fd != -1) close(listen_fd);
+        close(events_fd);
+        snapshot_free(&live.table);
+        return 1;
+    }
+
+    struct sigaction sa = {0};         // No SA_RESTART, so poll() returns on a signal
+    sa.sa_handler = daemon_on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);          // A client hanging up must not kill the daemon
+
+    fprintf(stderr, "Daemon: tracking %d processes, serving on %s\n", live.table.count, socket_path);
+    int status = 0;
+    while (!daemon_stop && status == 0) {
+        struct pollfd fds[2] = {{events_fd, POLLIN, 0}, {listen_fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR) continue; // Signal: re-check daemon_stop
+            print_error("poll failed", errno);
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            if (connector_drain(events_fd, &live, MSG_DONTWAIT) == -1) {
+                snapshot_free(&live.table); // Events were lost; start over from /proc
+                status = live_load(&live);
+            }
+        }
+        if (fds[1].revents & POLLIN && status == 0) {
+            int client = accept(listen_fd, NULL, NULL);
+            if (client != -1) {
+                status = daemon_serve(client, events_fd, &live);
+                close(client);
+            }
+        }
+    }
+    if (status == -1) fprintf(stderr, "Error: Daemon stopped: cannot rebuild the process table\n");
+
+    close(listen_fd);      // Stop accepting
+    unlink(socket_path);   // Remove our socket
+    close(events_fd);      // Unsubscribe
+    snapshot_free(&live.table);
+    free(live.exited);
+    return status == 0 ? 0 : 1;
+}
+
+// Send "root target [option [value]]" to a daemon and copy its answer to stdout
+int run_client(const char *socket_path, int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        fprintf(stderr, "Error: Incorrect number of arguments\n"); // Same arity as one-shot mode
+        return 1;
+    }
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", socket_path); // sun_path limit
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        print_error("Cannot connect to daemon", errno); // Daemon not running
+        if (fd != -1) close(fd);
+        return 1;
+    }
+
+    char line[1024]; // Query line in the daemon's wire format
+    size_t used = 0;
+    for (int i = 0; i < argc; i++) {
+        int n = snprintf(line + used, sizeof(line) - used, "%s%s", i ? " " : "", argv[i]);
+        if (n < 0 || (size_t)n >= sizeof(line) - used) {
+            fprintf(stderr, "Error: Query too long\n");
+            close(fd);
+            return 1;
+        }
+        used += (size_t)n;
+    }
+    line[used++] = '\n';
+    if (write(fd, line, used) != (ssize_t)used) {
+        print_error("Cannot send query to daemon", errno);
+        close(fd);
+        return 1;
+    }
+    shutdown(fd, SHUT_WR); // Query complete
+
+    char buf[65536]; // Relay the answer verbatim
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, (size_t)n, stdout);
+    }
+    close(fd);
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark mode: --bench forks synthetic trees and times every read-only option
+// plus -sk under two engines. "legacy" replays the pre-snapshot algorithms (a full
+// /proc scan per query and a stat read per is_in_tree() hop); "snapshot" is what a
+// one-shot invocation does today (snapshot_build() plus run_query()).
+// ---------------------------------------------------------------------------
+
+#define BENCH_LEGACY_BUDGET 1000000 // Skip legacy runs estimated to need more stat reads than this
+#define BENCH_IDLE_MS 3000          // Give up waiting for a tree that stops growing this long
+
+static const char *bench_shapes[] = {"wide", "deep", "zombie", "mixed"}; // Generator shapes
+static const char *bench_options[] = {"-dc", "-ds", "-id", "-lg", "-lz", "-df", "-gc", "-do"}; // Timed read-only options
+
+// Fanout of a shape: node i's children are fanout * i + 1 .. fanout * i + fanout
+static int bench_fanout(int shape, int size) {
+    switch (shape) {
+    case 0: return size > 1 ? size - 1 : 1; // wide: every node hangs off the root
+    case 1: return 1;                       // deep: a single chain
+    case 2: return 2;                       // zombie: binary tree whose leaves all exit unreaped
+    default: return 4;                      // mixed: 4-ary tree of running, zombie and stopped leaves
+    }
+}
+
+// Body of every generated process: fork this node's children, report readiness, take the leaf role
+static void bench_grow(int shape, int size, int ready_fd) {
+    int fanout = bench_fanout(shape, size);
+    long node = 0; // The forked root is node 0
+    for (long c = 1; c <= fanout && node * fanout + c < size; c++) {
+        pid_t child = fork();
+        if (child == 0) {
+            node = node * fanout + c; // Continue as the child node
+            c = 0;                    // Restart the loop over its own children
+        } else if (child == -1) {
+            break;                    // Out of PIDs or memory; keep the partial tree
+        }
+    }
+
+    int leaf = node * fanout + 1 >= size;
+    if (write(ready_fd, "", 1) != 1) _exit(1); // One byte per live node
+    if (leaf && (shape == 2 || (shape == 3 && node % 3 == 1))) {
+        _exit(0); // Parent never waits, so this stays a zombie
+    }
+    if (leaf && shape == 3 && node % 3 == 2) {
+        raise(SIGSTOP); // Shows up in state 'T'
+    }
+    for (;;) pause(); // Sleep until the benchmark kills the tree
+}
+
+// Fork a tree of up to size processes rooted at a new child; returns its PID and the count built
+static pid_t bench_spawn(int shape, int size, int *built) {
+    int ready[2];
+    if (pipe(ready) == -1) {
+        print_error("Cannot create readiness pipe", errno);
+        return -1;
+    }
+    fflush(NULL); // Children must not replay buffered output
+
+    pid_t root = fork();
+    if (root == 0) {
+        close(ready[0]);
+        setpgid(0, 0); // One process group, so cleanup is a single kill()
+        bench_grow(shape, size, ready[1]);
+    }
+    close(ready[1]);
+    if (root == -1) {
+        print_error("Cannot fork benchmark tree", errno);
+        close(ready[0]);
+        return -1;
+    }
+    setpgid(root, root); // Also from this side, so cleanup cannot race the child
+
+    *built = 0; // Count readiness bytes until every node reports or the tree stops growing
+    char buf[4096];
+    struct pollfd pfd = {ready[0], POLLIN, 0};
+    while (*built < size && poll(&pfd, 1, BENCH_IDLE_MS) > 0) {
+        ssize_t n = read(ready[0], buf, sizeof(buf));
+        if (n <= 0) break;
+        *built += (int)n;
+    }
+    close(ready[0]);
+    return root;
+}
+
+// Kill a generated tree and reap it; orphans reparent here because we are a subreaper
+static void bench_reap(pid_t root) {
+    kill(-root, SIGKILL); // Whole process group, stopped members included
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+    }
+}
+
+// Legacy is_in_tree(): one stat read per hop, capped at 1000 hops
+static int legacy_in_tree(pid_t root_pid, pid_t target_pid) {
+    if (root_pid == target_pid) return 1;
+    ProcessInfo info = get_process_info(target_pid);
+    if (info.pid == 0) return 0;
+    pid_t current = info.ppid;
+    int iterations = 0;
+    while (current != 0 && iterations++ < 1000) {
+        if (current == root_pid) return 1;
+        current = get_process_info(current).ppid;
+    }
+    return 0;
+}
+
+// Legacy child scan used by -gc: a full /proc pass per child
+static long legacy_count_children(pid_t pid) {
+    pid_t *pids;
+    int n = enumerate_pids(&pids);
+    long hits = 0;
+    for (int i = 0; i < n; i++) {
+        if (get_process_info(pids[i]).ppid == pid) hits++;
+    }
+    free(pids);
+    return hits;
+}
+
+// Legacy -sk pass: collect the subtree by scanning, signal it deepest first; returns PIDs signalled
+static long legacy_kill_pass(pid_t pid) {
+    pid_t *pids;
+    int n = enumerate_pids(&pids);
+    PidArena victims = {0};
+    for (int i = 0; i < n; i++) {
+        ProcessInfo info = get_process_info(pids[i]);
+        if (info.pid != 0 && legacy_in_tree(pid, pids[i]) && pids[i] != pid) pid_arena_push(&victims, pids[i]);
+    }
+    free(pids);
+    long killed = 0;
+    for (int i = victims.count - 1; i >= 0; i--) {
+        COUNT(syscalls, 1);
+        if (kill(victims.pids[i], SIGKILL) == 0) killed++;
+    }
+    pid_arena_free(&victims);
+    return killed;
+}
+
+// Answer one query the way the pre-snapshot code did; returns the number of matches, -1 on failure
+static long legacy_query(pid_t root_pid, pid_t pid, const char *option) {
+    if (get_process_info(root_pid).pid == 0 || !legacy_in_tree(root_pid, pid)) return -1;
+    if (strcmp(option, "-do") == 0) return get_process_info(pid).state == 'Z';
+    if (strcmp(option, "-sk") == 0) return legacy_kill_pass(pid) + legacy_kill_pass(pid); // Kill, then re-scan for misses
+
+    int siblings = strcmp(option, "-lg") == 0 || strcmp(option, "-lz") == 0;
+    pid_t parent = siblings ? get_process_info(pid).ppid : 0; // Sibling options read the target first
+    pid_t *pids;
+    int n = enumerate_pids(&pids);
+    long hits = 0;
+    for (int i = 0; i < n; i++) {
+        pid_t curr = pids[i];
+        if (siblings && curr == pid) continue;
+        ProcessInfo info = get_process_info(curr);
+        if (info.pid == 0) continue;
+        if (siblings) {
+            hits += info.ppid == parent && (option[2] == 'g' || info.state == 'Z');
+        } else if (strcmp(option, "-id") == 0) {
+            hits += info.ppid == pid;
+        } else if (strcmp(option, "-gc") == 0) {
+            if (info.ppid == pid) hits += legacy_count_children(curr); // Nested scan per child
+        } else if (legacy_in_tree(pid, curr)) {
+            if (strcmp(option, "-dc") == 0) hits += info.state == 'Z';
+            else if (strcmp(option, "-df") == 0) hits += info.state == 'Z' && curr != pid;
+            else hits += info.ppid != pid && curr != pid; // -ds
+        }
+    }
+    free(pids);
+    return hits;
+}
+
+// Stat reads the legacy engine would need for option on this table, for the skip budget
+static long legacy_estimate(const ProcessTable *table, pid_t pid, const char *option) {
+    long n = table->count;
+    if (strcmp(option, "-do") == 0) return 4;
+    if (strcmp(option, "-id") == 0 || option[1] == 'l') return n;
+    if (strcmp(option, "-gc") == 0) {
+        int slot = snapshot_slot(table, pid);
+        long kids = slot < 0 ? 0 : table->child_start[slot + 1] - table->child_start[slot];
+        return n * (1 + kids);
+    }
+
+    long reads = n; // Scans that call is_in_tree(): every entry walks up to pid or to the top
+    for (int i = 0; i < table->count && reads <= BENCH_LEGACY_BUDGET; i++) {
+        const ProcessInfo *p = &table->procs[i];
+        for (int hops = 0; p && p->pid != pid && p->ppid != 0 && hops < 1000; hops++) {
+            reads++;
+            if (p->ppid == pid) break;
+            p = snapshot_find(table, p->ppid);
+        }
+    }
+    return strcmp(option, "-sk") == 0 ? 2 * reads : reads;
+}
+
+// Point stdout and stderr at /dev/null while a handler runs; returns the saved pair
+static void bench_mute(int saved[2]) {
+    out_flush();
+    fflush(NULL);
+    saved[0] = dup(STDOUT_FILENO);
+    saved[1] = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null_fd != -1) {
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        close(null_fd);
+    }
+}
+
+static void bench_unmute(const int saved[2]) {
+    out_flush(); // Formatting and writing the answer count toward the timed run
+    fflush(NULL);
+    dup2(saved[0], STDOUT_FILENO);
+    dup2(saved[1], STDERR_FILENO);
+    close(saved[0]);
+    close(saved[1]);
+}
+
+// Time one query under one engine and print the result row
+static void bench_run(const char *shape, int procs, pid_t root, const char *option, int legacy) {
+    int saved[2];
+    ScanCounters before = scan_counters;
+    bench_mute(saved);
+    double start = monotonic_ms();
+    if (legacy) {
+        legacy_query(1, root, option);
+    } else {
+        ProcessTable table;
+        Query query = {1, root, option, 0};
+        if (snapshot_build_for(&table, &query) == 0) {
+            run_query(&table, &query);
+            snapshot_free(&table);
+        }
+    }
+    double elapsed = monotonic_ms() - start;
+    bench_unmute(saved);
+    printf("%-7s %7d  %-4s %-9s %10.2f %10lu %10lu\n", shape, procs, option, legacy ? "legacy" : "snapshot", elapsed,
+           scan_counters.syscalls - before.syscalls, scan_counters.stat_reads - before.stat_reads);
+    fflush(stdout);
+}
+
+// Run the legacy engine only when it fits the budget; otherwise say why it was skipped
+static void bench_run_legacy(const ProcessTable *table, const char *shape, int procs, pid_t root, const char *option) {
+    long estimate = legacy_estimate(table, root, option);
+    if (estimate > BENCH_LEGACY_BUDGET) {
+        printf("%-7s %7d  %-4s %-9s %10s (estimated %ld stat reads)\n", shape, procs, option, "legacy", "skipped", estimate);
+        return;
+    }
+    bench_run(shape, procs, root, option, 1);
+}
+
+// Time -sk issued from inside the target's subtree: a helper process adopts a generated tree and
+// forks the killer as its own child, then reports whether the killer stopped itself or left survivors
+static void bench_inside(const char *shape_name, int shape, int size) {
+    fflush(NULL);
+    double start = monotonic_ms();
+    pid_t helper = fork();
+    if (helper == 0) {
+        prctl(PR_SET_CHILD_SUBREAPER, 1); // Orphans of the kill stay inside the subtree
+        int built;
+        pid_t root = bench_spawn(shape, size, &built);
+        if (root == -1) _exit(3);
+        pid_t killer = fork();
+        if (killer == 0) {
+            int saved[2];
+            ProcessTable table;
+            Query query = {1, getppid(), "-sk", 0};
+            bench_mute(saved);
+            if (snapshot_build_for(&table, &query) == 0) run_query(&table, &query);
+            bench_unmute(saved);
+            _exit(0);
+        }
+        int status = 0;
+        while (killer > 0 && waitpid(killer, &status, WUNTRACED) == -1 && errno == EINTR) {
+        }
+        int verdict = 0;
+        if (WIFSTOPPED(status)) {
+            verdict = 1; // The killer froze itself
+            kill(killer, SIGKILL);
+            kill(killer, SIGCONT);
+        } else {
+            double settle = monotonic_ms(); // SIGKILLed processes may still be running their exit path
+            do {
+                ProcessTable after;
+                if (snapshot_build(&after, SNAPSHOT_BASIC) == -1) break;
+                int *slots;
+                int n = snapshot_subtree(&after, getpid(), &slots);
+                verdict = 0;
+                for (int i = 1; i < n && verdict == 0; i++) verdict = after.procs[slots[i]].state != 'Z' ? 2 : 0;
+                if (n >= 0) free(slots);
+                snapshot_free(&after);
+            } while (verdict == 2 && monotonic_ms() - settle < BENCH_IDLE_MS && usleep(10000) == 0);
+        }
+        bench_reap(root);
+        _exit(verdict);
+    }
+    if (helper == -1) {
+        print_error("Cannot fork benchmark helper", errno);
+        return;
+    }
+    int status = 0;
+    while (waitpid(helper, &status, 0) == -1 && errno == EINTR) {
+    }
+    const char *verdicts[] = {"ok", "stopped itself", "left survivors", "no tree"};
+    int verdict = WIFEXITED(status) && WEXITSTATUS(status) <= 3 ? WEXITSTATUS(status) : 3;
+    printf("%-7s %7d  %-4s %-9s %10.2f %s\n", shape_name, size, "-sk", "inside", monotonic_ms() - start, verdicts[verdict]);
+    fflush(stdout);
+}
+
+// Benchmark every option on one shape and size: read-only options share a tree, -sk gets a fresh one per engine
+static int bench_shape(int shape, int size) {
+    const char *name = bench_shapes[shape];
+    int built;
+    pid_t root = bench_spawn(shape, size, &built);
+    if (root == -1) return -1;
+    if (built < size) {
+        fprintf(stderr, "Warning: %s tree stopped at %d of %d processes\n", name, built, size); // Hit pid_max or limits
+    }
+
+    ProcessTable table; // Used only to size the legacy runs
+    if (snapshot_build(&table, SNAPSHOT_BASIC) == -1) {
+        bench_reap(root);
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(bench_options) / sizeof(bench_options[0]); i++) {
+        bench_run_legacy(&table, name, built, root, bench_options[i]);
+        bench_run(name, built, root, bench_options[i], 0);
+    }
+    snapshot_free(&table);
+    bench_reap(root);
+
+    for (int legacy = 1; legacy >= 0; legacy--) {
+        root = bench_spawn(shape, size, &built);
+        if (root == -1) return -1;
+        if (legacy) {
+            if (snapshot_build(&table, SNAPSHOT_BASIC) == -1) {
+                bench_reap(root);
+                return -1;
+            }
+            bench_run_legacy(&table, name, built, root, "-sk");
+            snapshot_free(&table);
+        } else {
+            bench_run(name, built, root, "-sk", 0);
+        }
+        bench_reap(root);
+    }
+    bench_inside(name, shape, size);
+    return 0;
+}
+
+// --bench [wide|deep|zombie|mixed|all] [SIZE...]: defaults to every shape at 1000 processes
+int run_bench(int argc, char *argv[]) {
+    int first = 0, last = 3; // Shapes to run
+    int arg = 0;
+    if (arg < argc && (*argv[arg] < '0' || *argv[arg] > '9')) {
+        if (strcmp(argv[arg], "all") != 0) {
+            for (first = 0; first < 4 && strcmp(argv[arg], bench_shapes[first]) != 0; first++) {
+            }
+            if (first == 4) {
+                fprintf(stderr, "Error: Unknown benchmark shape '%s' (wide, deep, zombie, mixed, all)\n", argv[arg]);
+                return 1;
+            }
+            last = first;
+        }
+        arg++;
+    }
+
+    int sizes[16];
+    int nsizes = 0;
+    for (; arg < argc; arg++) {
+        char *end;
+        long size = strtol(argv[arg], &end, 10);
+        if (*argv[arg] == '\0' || *end != '\0' || size < 2 || size > 4194304 || nsizes == 16) {
+            fprintf(stderr, "Error: --bench expects up to 16 sizes between 2 and 4194304, got '%s'\n", argv[arg]);
+            return 1;
+        }
+        sizes[nsizes++] = (int)size;
+    }
+    if (nsizes == 0) sizes[nsizes++] = 1000;
+
+    // Orphans of killed subtrees reparent here, so every generated process gets reaped
+    if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1) {
+        print_error("Cannot become a child subreaper", errno);
+        return 1;
+    }
+
+    printf("%-7s %7s  %-4s %-9s %10s %10s %10s\n", "shape", "procs", "opt", "engine", "wall_ms", "syscalls", "stat_reads");
+    for (int i = 0; i < nsizes; i++) {
+        for (int shape = first; shape <= last; shape++) {
+            if (bench_shape(shape, sizes[i]) == -1) return 1;
+        }
+    }
+    return 0;
+}